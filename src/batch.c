@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hough-dump.h"
+#include "hough-pixbuf.h"
+#include "loader.h"
+#include "rawimg.h"
+#include "stream.h"
+#include "view.h"
+
+static int bits = 8;
+static int pyramid = 0;
+static int height = CANONICAL_HEIGHT;
+static gboolean sampled = FALSE;
+static gboolean oriented = FALSE;
+static gboolean template = FALSE;
+static gboolean thin = FALSE;
+static gboolean arcs = FALSE;
+static gboolean deskew = FALSE;
+static int open_radius = 0;
+static int close_radius = 0;
+static int seed = 0;
+static int cache_mb = 0;
+static int n_threads = 0;
+static int n_decoders = 2;
+static int prefetch = 0;
+static gchar *threshold_name = "fixed";
+static gchar *dump_path = NULL;
+static hough_threshold threshold;
+static hough_cache *cache;
+static hough_dump *dump;
+
+static GOptionEntry entries[] =
+{
+  {"bits", 'b', 0, G_OPTION_ARG_INT, &bits,
+   "Bits per pixel of converted planes (1 or 8)", "N"},
+  {"pyramid", 'p', 0, G_OPTION_ARG_INT, &pyramid,
+   "Coarse voting factor (0 - by image size, 1 - off)", "N"},
+  {"height", 'H', 0, G_OPTION_ARG_INT, &height,
+   "Canonical digit height (0 - no resampling)", "N"},
+  {"sampled", 's', 0, G_OPTION_ARG_NONE, &sampled,
+   "Vote with a random sample of pixels", NULL},
+  {"oriented", 'o', 0, G_OPTION_ARG_NONE, &oriented,
+   "Vote with stroke edges near their normal only", NULL},
+  {"template", 'T', 0, G_OPTION_ARG_NONE, &template,
+   "Classify by the nearest of the drawn digit prototypes", NULL},
+  {"thin", 0, 0, G_OPTION_ARG_NONE, &thin,
+   "Vote with the skeleton of the strokes", NULL},
+  {"arcs", 0, 0, G_OPTION_ARG_NONE, &arcs,
+   "Tell 0, 6, 8 and 9 by their round bowls first", NULL},
+  {"deskew", 0, 0, G_OPTION_ARG_NONE, &deskew,
+   "Turn digits rotated by up to 10 degrees upright first", NULL},
+  {"open", 0, 0, G_OPTION_ARG_INT, &open_radius,
+   "Remove dark specks smaller than a square of side 2N+1", "N"},
+  {"close", 0, 0, G_OPTION_ARG_INT, &close_radius,
+   "Fill light holes smaller than a square of side 2N+1", "N"},
+  {"seed", 0, 0, G_OPTION_ARG_INT, &seed,
+   "Seed of the pixel sampling order", "N"},
+  {"cache-mb", 'c', 0, G_OPTION_ARG_INT, &cache_mb,
+   "Remember results of up to N megabytes of distinct crops", "N"},
+  {"threshold", 0, 0, G_OPTION_ARG_STRING, &threshold_name,
+   "Binarization of decoded images: fixed, otsu or adaptive", "MODE"},
+  {"threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+   "Recognition threads of the images command (0 - one per CPU)", "N"},
+  {"decoders", 'd', 0, G_OPTION_ARG_INT, &n_decoders,
+   "Image decoding threads of the images command", "N"},
+  {"prefetch", 0, 0, G_OPTION_ARG_INT, &prefetch,
+   "Images decoded ahead at most (0 - twice the threads)", "N"},
+  {"dump", 0, 0, G_OPTION_ARG_FILENAME, &dump_path,
+   "Write the votes and lines of recognize and images to FILE, "
+   "compressed if it ends in .gz", "FILE"},
+  {NULL}
+};
+
+static int
+convert(const gchar *output, gchar **files, int n_files)
+{
+  hough_plane *planes;
+  guchar **buffers;
+  GError *error;
+  int status;
+
+  planes = g_new0(hough_plane, n_files);
+  buffers = g_new0(guchar*, n_files);
+  error = NULL;
+  status = EXIT_SUCCESS;
+
+  for(int i = 0; i < n_files; ++i)
+    {
+      GdkPixbuf *image = gdk_pixbuf_new_from_file(files[i], &error);
+      hough_plane view;
+
+      if(image == NULL)
+        {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+          status = EXIT_FAILURE;
+          goto out;
+        }
+      hough_plane_from_pixbuf(image, &view);
+      if(threshold == PLANE_THRESHOLD_FIXED)
+        buffers[i] = hough_plane_gray(&view, &planes[i]);
+      else
+        buffers[i] = hough_plane_threshold(&view, threshold, &planes[i]);
+      g_object_unref(image);
+    }
+
+  if(!raw_container_write(output, planes, n_files, bits, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      status = EXIT_FAILURE;
+    }
+
+out:
+  for(int i = 0; i < n_files; ++i)
+    g_free(buffers[i]);
+  g_free(buffers);
+  g_free(planes);
+  return status;
+}
+
+static gint
+compare_names(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+static void
+batch_options(hough_options *options)
+{
+  hough_options_init(options);
+  options->pyramid_factor = pyramid;
+  options->canonical_height = height;
+  options->vote_mode = oriented ? HOUGH_VOTE_ORIENTED :
+      sampled ? HOUGH_VOTE_SAMPLED : HOUGH_VOTE_FULL;
+  options->classifier = template ? HOUGH_CLASSIFY_TEMPLATE :
+      HOUGH_CLASSIFY_LINES;
+  options->thin = thin;
+  options->arcs = arcs;
+  options->deskew = deskew;
+  options->open_radius = open_radius;
+  options->close_radius = close_radius;
+  options->seed = seed;
+  options->cache = cache;
+  options->keep_votes = dump != NULL;
+}
+
+/* recognize_plane(), the votes and lines go to the dump if there is one */
+static int
+recognize_dumped(const hough_plane *plane,
+                 const hough_options *options,
+                 const gchar *label)
+{
+  hough_result result;
+  GError *error;
+  int digit;
+
+  if(dump == NULL)
+    return recognize_plane(plane, options);
+  error = NULL;
+  digit = recognize_plane_result(plane, options, &result);
+  if(!hough_dump_write(dump, label, &result, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+    }
+  hough_result_clear(&result);
+  return digit;
+}
+
+static void
+print_thin_stats(void)
+{
+  hough_stage_stats stats;
+
+  hough_thin_stats(&stats);
+  g_printerr("thinning: %" G_GUINT64_FORMAT " crops, %.1f ms, "
+             "%" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT " dark pixels\n",
+             stats.calls, stats.usec / 1e3,
+             stats.pixels_in, stats.pixels_out);
+}
+
+static int
+recognize(const gchar *path)
+{
+  raw_container *container;
+  hough_plane plane;
+  hough_options options;
+  GError *error;
+  int n_images;
+
+  error = NULL;
+  container = raw_container_open(path, &error);
+  if(container == NULL)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+  batch_options(&options);
+
+  n_images = raw_container_get_n_images(container);
+  for(int i = 0; i < n_images; ++i)
+    {
+      gchar *label = g_strdup_printf("%s:%i", path, i);
+
+      raw_container_get_plane(container, i, &plane);
+      g_print("%s: %i\n", label, recognize_dumped(&plane, &options, label));
+      g_free(label);
+    }
+
+  raw_container_close(container);
+  return EXIT_SUCCESS;
+}
+
+typedef struct images_job
+{
+  image_loader *loader;
+  const hough_options *options;
+  gint failed;
+} images_job;
+
+static gpointer
+recognize_loaded(gpointer data)
+{
+  images_job *job = data;
+  loaded_image *image;
+
+  while((image = image_loader_next(job->loader)) != NULL)
+    {
+      hough_plane binary;
+      guchar *buffer;
+
+      if(image->error != NULL)
+        {
+          g_printerr("%s\n", image->error->message);
+          g_atomic_int_set(&job->failed, TRUE);
+          image_loader_release(job->loader, image);
+          continue;
+        }
+      buffer = NULL;
+      if(threshold != PLANE_THRESHOLD_FIXED)
+        buffer = hough_plane_threshold(&image->plane, threshold, &binary);
+      g_print("%s: %i\n", image->path,
+              recognize_dumped(buffer != NULL ? &binary : &image->plane,
+                               job->options, image->path));
+      g_free(buffer);
+      image_loader_release(job->loader, image);
+    }
+  return NULL;
+}
+
+/* Files of the arguments, directories in name order */
+static GPtrArray*
+list_images(gchar **args, int n_args)
+{
+  GPtrArray *files;
+
+  files = g_ptr_array_new_with_free_func(g_free);
+  for(int i = 0; i < n_args; ++i)
+    {
+      GPtrArray *names;
+      const gchar *name;
+      GDir *dir;
+
+      dir = g_file_test(args[i], G_FILE_TEST_IS_DIR) ?
+          g_dir_open(args[i], 0, NULL) : NULL;
+      if(dir == NULL)
+        {
+          g_ptr_array_add(files, g_strdup(args[i]));
+          continue;
+        }
+      names = g_ptr_array_new();
+      while((name = g_dir_read_name(dir)) != NULL)
+        g_ptr_array_add(names, g_build_filename(args[i], name, NULL));
+      g_dir_close(dir);
+      g_ptr_array_sort(names, compare_names);
+      for(guint k = 0; k < names->len; ++k)
+        g_ptr_array_add(files, g_ptr_array_index(names, k));
+      g_ptr_array_free(names, TRUE);
+    }
+  return files;
+}
+
+static int
+recognize_images(gchar **args, int n_args)
+{
+  hough_options options;
+  images_job job;
+  GPtrArray *files;
+  GThread **workers;
+  gint64 start;
+  int threads;
+
+  batch_options(&options);
+  files = list_images(args, n_args);
+  threads = n_threads > 0 ? n_threads : (int)g_get_num_processors();
+
+  start = g_get_monotonic_time();
+  job.loader = image_loader_new((gchar**)files->pdata, files->len,
+                                n_decoders,
+                                prefetch > 0 ? prefetch : 2 * threads,
+                                height, threshold);
+  job.options = &options;
+  job.failed = FALSE;
+  workers = g_new(GThread*, threads);
+  for(int k = 0; k < threads; ++k)
+    workers[k] = g_thread_new("recognize", recognize_loaded, &job);
+  for(int k = 0; k < threads; ++k)
+    g_thread_join(workers[k]);
+  image_loader_free(job.loader);
+
+  g_printerr("%u images, %.1f images/s\n", files->len,
+             files->len * 1e6 / MAX(g_get_monotonic_time() - start, 1));
+  g_free(workers);
+  g_ptr_array_unref(files);
+  return job.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error;
+  int status;
+
+  error = NULL;
+  context = g_option_context_new("COMMAND ARGS... - batch digit recognition");
+  g_option_context_set_summary(context,
+                               "Commands:\n"
+                               "  convert OUTPUT IMAGE...  "
+                               "pack images into a raw container\n"
+                               "  recognize CONTAINER...   "
+                               "recognize every image of a raw container\n"
+                               "  stream DIRECTORY|-       "
+                               "recognize a frame sequence as it comes\n"
+                               "  images FILE|DIRECTORY... "
+                               "recognize image files on several threads\n"
+                               "  view DUMP [DIRECTORY]    "
+                               "print the peaks of a --dump, draw them too");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if(!g_option_context_parse(context, &argc, &argv, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(context);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free(context);
+
+  if(bits != 1 && bits != 8)
+    {
+      g_printerr("--bits must be 1 or 8\n");
+      return EXIT_FAILURE;
+    }
+  if(pyramid < 0 || height < 0 || cache_mb < 0 ||
+     open_radius < 0 || close_radius < 0 || n_threads < 0 || prefetch < 0)
+    {
+      g_printerr("--pyramid, --height, --cache-mb, --open, --close, "
+                 "--threads and --prefetch must not be negative\n");
+      return EXIT_FAILURE;
+    }
+  if(n_decoders < 1)
+    {
+      g_printerr("--decoders must be positive\n");
+      return EXIT_FAILURE;
+    }
+  if(strcmp(threshold_name, "fixed") == 0)
+    threshold = PLANE_THRESHOLD_FIXED;
+  else if(strcmp(threshold_name, "otsu") == 0)
+    threshold = PLANE_THRESHOLD_OTSU;
+  else if(strcmp(threshold_name, "adaptive") == 0)
+    threshold = PLANE_THRESHOLD_ADAPTIVE;
+  else
+    {
+      g_printerr("--threshold must be fixed, otsu or adaptive\n");
+      return EXIT_FAILURE;
+    }
+  if(cache_mb > 0)
+    cache = hough_cache_new((gsize)cache_mb * 1024 * 1024);
+  if(dump_path != NULL)
+    {
+      dump = hough_dump_create(dump_path, g_str_has_suffix(dump_path, ".gz"),
+                               &error);
+      if(dump == NULL)
+        {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+          return EXIT_FAILURE;
+        }
+    }
+
+  status = EXIT_FAILURE;
+  if(argc >= 4 && strcmp(argv[1], "convert") == 0)
+    status = convert(argv[2], argv + 3, argc - 3);
+  else if(argc >= 3 && strcmp(argv[1], "recognize") == 0)
+    {
+      status = EXIT_SUCCESS;
+      for(int i = 2; i < argc; ++i)
+        if(recognize(argv[i]) != EXIT_SUCCESS)
+          status = EXIT_FAILURE;
+    }
+  else if(argc == 3 && strcmp(argv[1], "stream") == 0)
+    {
+      hough_options options;
+
+      batch_options(&options);
+      status = stream_frames(argv[2], threshold, &options);
+    }
+  else if(argc >= 3 && strcmp(argv[1], "images") == 0)
+    status = recognize_images(argv + 2, argc - 2);
+  else if((argc == 3 || argc == 4) && strcmp(argv[1], "view") == 0)
+    status = view_dump(argv[2], argc == 4 ? argv[3] : NULL);
+  else
+    g_printerr("Usage: %s convert|recognize|stream|images|view ARGS..., see --help\n",
+               argv[0]);
+
+  if(cache != NULL)
+    {
+      guint64 hits, misses;
+
+      hough_cache_stats(cache, &hits, &misses);
+      g_printerr("cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+                 " misses\n", hits, misses);
+      hough_cache_free(cache);
+    }
+  if(dump != NULL && !hough_dump_close(dump, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      status = EXIT_FAILURE;
+    }
+  if(thin)
+    print_thin_stats();
+  return status;
+}
@@ -0,0 +1,102 @@
+/* Times voting of the draw_digit() set at 45, 5 and 1 degree steps:
+ * one int row per angle filled pixel by pixel, against the blocked
+ * layout with 16-bit counters. Digits are brought to the canonical
+ * height like recognition does, or to the height given. */
+#include <stdio.h>
+#include <stdlib.h>
+#include "imgproc.h"
+#include "hough-pixbuf.h"
+
+#define ROUNDS 20
+#define N_DIGITS 10
+
+static const int steps[] = {45, 5, 1};
+
+static void
+bench_step(const hough_plane *digits, int angle_step)
+{
+  gint64 start, spent_int, spent_blocked;
+  int width, height, differ;
+
+  spent_int = 0;
+  spent_blocked = 0;
+  differ = 0;
+  for(int d = 0; d < N_DIGITS; ++d)
+    {
+      int *matrix = NULL;
+      guint16 *votes = NULL;
+
+      start = g_get_monotonic_time();
+      for(int r = 0; r < ROUNDS; ++r)
+        {
+          free(matrix);
+          matrix = accum_matrix_angles(&digits[d], angle_step,
+                                       &width, &height);
+        }
+      spent_int += g_get_monotonic_time() - start;
+
+      start = g_get_monotonic_time();
+      for(int r = 0; r < ROUNDS; ++r)
+        {
+          g_free(votes);
+          votes = accum_matrix_blocked(&digits[d], angle_step,
+                                       &width, &height);
+        }
+      spent_blocked += g_get_monotonic_time() - start;
+
+      for(int i = 0; i < width * height; ++i)
+        differ += matrix[i] != votes[i];
+      free(matrix);
+      g_free(votes);
+    }
+
+  g_print("  %2i deg, %4ix%-3i  int %8.3f ms %6zu KiB   "
+          "blocked %8.3f ms %6zu KiB   %i votes differ\n",
+          angle_step, width, height,
+          spent_int / 1e3 / ROUNDS / N_DIGITS,
+          width * height * sizeof (int) / 1024,
+          spent_blocked / 1e3 / ROUNDS / N_DIGITS,
+          width * height * sizeof (guint16) / 1024,
+          differ);
+}
+
+int main(int argc, char **argv)
+{
+  hough_plane digits[N_DIGITS];
+  guchar *buffers[N_DIGITS];
+  int canonical;
+
+  canonical = argc > 1 ? atoi(argv[1]) : CANONICAL_HEIGHT;
+  for(int d = 0; d < N_DIGITS; ++d)
+    {
+      GdkPixbuf *image = draw_digit(d);
+      hough_plane view, binary, cropped;
+
+      hough_plane_from_pixbuf(image, &view);
+      buffers[d] = hough_plane_binarize(&view, &binary);
+      g_object_unref(image);
+      hough_plane_crop(&binary, &cropped);
+      if(canonical > 0)
+        {
+          guchar *resampled;
+
+          resampled = hough_plane_resample(&cropped,
+                                           MAX(1, cropped.width * canonical /
+                                               cropped.height),
+                                           canonical, &digits[d]);
+          g_free(buffers[d]);
+          buffers[d] = resampled;
+        }
+      else
+        digits[d] = cropped;
+    }
+
+  g_print("draw_digit() set, %s\n", canonical > 0 ?
+          "resampled to the canonical height" : "full resolution");
+  for(int s = 0; s < G_N_ELEMENTS(steps); ++s)
+    bench_step(digits, steps[s]);
+
+  for(int d = 0; d < N_DIGITS; ++d)
+    g_free(buffers[d]);
+  return EXIT_SUCCESS;
+}
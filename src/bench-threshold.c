@@ -0,0 +1,109 @@
+/* Times binarization of the given images: toBinary(), the OpenCV path
+ * of the GUI, against the packed kernels of hough-plane.c working on
+ * the pixbuf memory, serial and split in row bands over all cores */
+#include <stdio.h>
+#include <stdlib.h>
+#include "imgproc.h"
+#include "hough-pixbuf.h"
+
+#define ROUNDS 20
+
+static int
+count_dark(const hough_plane *plane)
+{
+  int n = 0;
+
+  for(int i = 0; i < plane->height; ++i)
+    for(int j = 0; j < plane->width; ++j)
+      n += hough_plane_is_dark(plane, j, i);
+  return n;
+}
+
+static void
+bench_tobinary(const GdkPixbuf *image,
+               GdkPixbuf *(*binarize)(const GdkPixbuf *image),
+               const gchar *name)
+{
+  GdkPixbuf *binary;
+  hough_plane plane;
+  gint64 start, spent;
+
+  binary = NULL;
+  start = g_get_monotonic_time();
+  for(int r = 0; r < ROUNDS; ++r)
+    {
+      if(binary != NULL)
+        g_object_unref(binary);
+      binary = binarize(image);
+    }
+  spent = g_get_monotonic_time() - start;
+
+  hough_plane_from_pixbuf(binary, &plane);
+  g_print("  %-18s %8.3f ms %9i dark\n", name,
+          spent / 1e3 / ROUNDS, count_dark(&plane));
+  g_object_unref(binary);
+}
+
+static void
+bench_kernel(const GdkPixbuf *image, hough_threshold mode, const gchar *name,
+             gboolean parallel)
+{
+  hough_plane view, binary;
+  guchar *buffer;
+  gint64 start, spent;
+
+  hough_plane_from_pixbuf(image, &view);
+  buffer = NULL;
+  start = g_get_monotonic_time();
+  for(int r = 0; r < ROUNDS; ++r)
+    {
+      g_free(buffer);
+      buffer = parallel ? hough_plane_threshold_parallel(&view, mode, &binary) :
+          hough_plane_threshold(&view, mode, &binary);
+    }
+  spent = g_get_monotonic_time() - start;
+
+  g_print("  %-9s %-8s %8.3f ms %9i dark\n", name,
+          parallel ? "parallel" : "", spent / 1e3 / ROUNDS,
+          count_dark(&binary));
+  g_free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+  int status;
+
+  if(argc < 2)
+    {
+      g_printerr("Usage: %s IMAGE...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  status = EXIT_SUCCESS;
+  for(int i = 1; i < argc; ++i)
+    {
+      GError *error = NULL;
+      GdkPixbuf *image = gdk_pixbuf_new_from_file(argv[i], &error);
+
+      if(image == NULL)
+        {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+          status = EXIT_FAILURE;
+          continue;
+        }
+      g_print("%s: %ix%i, %i channels\n", argv[i],
+              gdk_pixbuf_get_width(image), gdk_pixbuf_get_height(image),
+              gdk_pixbuf_get_n_channels(image));
+      bench_tobinary(image, toBinary, "toBinary");
+      bench_tobinary(image, toBinary_parallel, "toBinary parallel");
+      for(int parallel = 0; parallel <= 1; ++parallel)
+        {
+          bench_kernel(image, PLANE_THRESHOLD_FIXED, "fixed", parallel);
+          bench_kernel(image, PLANE_THRESHOLD_OTSU, "otsu", parallel);
+          bench_kernel(image, PLANE_THRESHOLD_ADAPTIVE, "adaptive", parallel);
+        }
+      g_object_unref(image);
+    }
+  return status;
+}
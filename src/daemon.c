@@ -0,0 +1,530 @@
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "hough-recog.h"
+#include "shmring.h"
+
+/* Framing, all fields are 32-bit little endian:
+ *   request   id, width, height, bits (1 or 8), then height rows of
+ *             width bytes (8-bit gray) or (width + 7) / 8 bytes (1-bit,
+ *             packed as in hough_plane)
+ *   response  id, digit (-1 if not recognized), confidence in 1/1000
+ * A client may send any number of requests without waiting; responses
+ * carry the request id and come back in completion order.
+ *
+ * With --shm the daemon also serves a shared memory frame ring (see
+ * shmring.h), frames are recognized in place. */
+
+#define REQUEST_SIZE 16
+#define RESPONSE_SIZE 12
+#define MAX_SIDE 16384
+#define MAX_IN_FLIGHT 64
+#define MAX_POOLED 256
+#define RING_SLOTS 16
+#define RING_SLOT_SIZE (4 * 1024 * 1024)
+
+/* Responses are queued by the workers and sent by a writer thread of
+ * the connection, so that a client that does not read only stalls
+ * itself. A request counts as in flight until its response is sent. */
+typedef struct connection
+{
+  int fd;
+  gint ref_count;
+  GMutex lock;
+  GCond drained;
+  GCond ready;
+  int in_flight;
+  GByteArray *responses;
+  gboolean reading_done;
+} connection;
+
+/* a frame from a connection or from a ring slot */
+typedef struct job
+{
+  connection *conn;
+  shm_ring *ring;
+  int slot;
+  guint32 id;
+  hough_plane plane;
+  guchar *buffer;
+  gsize capacity;
+} job;
+
+static gchar *socket_path = "/tmp/hough.sock";
+static int n_threads = 0;
+static int pyramid = 0;
+static int height = CANONICAL_HEIGHT;
+static gboolean sampled = FALSE;
+static gboolean oriented = FALSE;
+static gboolean template = FALSE;
+static gboolean thin = FALSE;
+static gboolean arcs = FALSE;
+static gboolean deskew = FALSE;
+static int open_radius = 0;
+static int close_radius = 0;
+static gchar *shm_name = NULL;
+static int ring_slots = RING_SLOTS;
+static int ring_slot_size = RING_SLOT_SIZE;
+static int cache_mb = 0;
+
+static GOptionEntry entries[] =
+{
+  {"socket", 'S', 0, G_OPTION_ARG_FILENAME, &socket_path,
+   "Unix socket to listen on", "PATH"},
+  {"threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+   "Recognition threads (0 - one per processor)", "N"},
+  {"pyramid", 'p', 0, G_OPTION_ARG_INT, &pyramid,
+   "Coarse voting factor (0 - by image size, 1 - off)", "N"},
+  {"height", 'H', 0, G_OPTION_ARG_INT, &height,
+   "Canonical digit height (0 - no resampling)", "N"},
+  {"sampled", 's', 0, G_OPTION_ARG_NONE, &sampled,
+   "Vote with a random sample of pixels", NULL},
+  {"oriented", 'o', 0, G_OPTION_ARG_NONE, &oriented,
+   "Vote with stroke edges near their normal only", NULL},
+  {"template", 'T', 0, G_OPTION_ARG_NONE, &template,
+   "Classify by the nearest of the drawn digit prototypes", NULL},
+  {"thin", 0, 0, G_OPTION_ARG_NONE, &thin,
+   "Vote with the skeleton of the strokes", NULL},
+  {"arcs", 0, 0, G_OPTION_ARG_NONE, &arcs,
+   "Tell 0, 6, 8 and 9 by their round bowls first", NULL},
+  {"deskew", 0, 0, G_OPTION_ARG_NONE, &deskew,
+   "Turn digits rotated by up to 10 degrees upright first", NULL},
+  {"open", 0, 0, G_OPTION_ARG_INT, &open_radius,
+   "Remove dark specks smaller than a square of side 2N+1", "N"},
+  {"close", 0, 0, G_OPTION_ARG_INT, &close_radius,
+   "Fill light holes smaller than a square of side 2N+1", "N"},
+  {"shm", 0, 0, G_OPTION_ARG_STRING, &shm_name,
+   "Also serve a shared memory frame ring", "NAME"},
+  {"slots", 0, 0, G_OPTION_ARG_INT, &ring_slots,
+   "Frame slots of the ring", "N"},
+  {"slot-size", 0, 0, G_OPTION_ARG_INT, &ring_slot_size,
+   "Bytes per ring slot", "BYTES"},
+  {"cache-mb", 'c', 0, G_OPTION_ARG_INT, &cache_mb,
+   "Remember results of up to N megabytes of distinct crops", "N"},
+  {NULL}
+};
+
+static hough_options options;
+static GThreadPool *workers;
+
+/* Spent jobs keep their frame buffers, so that a steady stream of
+ * requests does not allocate */
+static GMutex pool_lock;
+static GSList *pool;
+static int n_pooled;
+
+static job*
+job_get(gsize size)
+{
+  job *j;
+
+  g_mutex_lock(&pool_lock);
+  j = pool != NULL ? pool->data : NULL;
+  if(j != NULL)
+    {
+      pool = g_slist_delete_link(pool, pool);
+      n_pooled--;
+    }
+  g_mutex_unlock(&pool_lock);
+
+  if(j == NULL)
+    j = g_new0(job, 1);
+  if(j->capacity < size)
+    {
+      g_free(j->buffer);
+      j->buffer = g_malloc(size);
+      j->capacity = size;
+    }
+  return j;
+}
+
+static void
+job_put(job *j)
+{
+  g_mutex_lock(&pool_lock);
+  if(n_pooled < MAX_POOLED)
+    {
+      pool = g_slist_prepend(pool, j);
+      n_pooled++;
+      j = NULL;
+    }
+  g_mutex_unlock(&pool_lock);
+
+  if(j != NULL)
+    {
+      g_free(j->buffer);
+      g_free(j);
+    }
+}
+
+static void
+connection_unref(connection *conn)
+{
+  if(!g_atomic_int_dec_and_test(&conn->ref_count))
+    return;
+  close(conn->fd);
+  g_byte_array_free(conn->responses, TRUE);
+  g_mutex_clear(&conn->lock);
+  g_cond_clear(&conn->drained);
+  g_cond_clear(&conn->ready);
+  g_free(conn);
+}
+
+static gboolean
+read_full(int fd, guchar *data, gsize size)
+{
+  while(size > 0)
+    {
+      ssize_t n = read(fd, data, size);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        return FALSE;
+      data += n;
+      size -= n;
+    }
+  return TRUE;
+}
+
+static gboolean
+write_full(int fd, const guchar *data, gsize size)
+{
+  while(size > 0)
+    {
+      ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        return FALSE;
+      data += n;
+      size -= n;
+    }
+  return TRUE;
+}
+
+static guint32
+read_u32(const guchar *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static void
+write_u32(guchar *p, guint32 value)
+{
+  for(int i = 0; i < 4; ++i)
+    p[i] = (value >> (8 * i)) & 0xff;
+}
+
+static void
+recognize_job(gpointer data, gpointer user_data)
+{
+  job *j = data;
+  connection *conn = j->conn;
+  guchar response[RESPONSE_SIZE];
+  double confidence;
+  int digit;
+
+  digit = recognize_plane_confidence(&j->plane, &options, &confidence);
+  if(j->ring != NULL)
+    {
+      shm_ring_complete(j->ring, j->slot, j->id, digit,
+                        round(confidence * 1000));
+      job_put(j);
+      return;
+    }
+
+  write_u32(response, j->id);
+  write_u32(response + 4, (guint32)digit);
+  write_u32(response + 8, round(confidence * 1000));
+
+  g_mutex_lock(&conn->lock);
+  g_byte_array_append(conn->responses, response, RESPONSE_SIZE);
+  g_cond_signal(&conn->ready);
+  g_mutex_unlock(&conn->lock);
+
+  job_put(j);
+  connection_unref(conn);
+}
+
+/* Sends the queued responses until the reader is done and nothing is
+ * in flight. After a failed send the peer is gone: the socket is shut
+ * down so that the reader stops too, and the rest is dropped. */
+static gpointer
+write_responses(gpointer data)
+{
+  connection *conn = data;
+  guchar batch[MAX_IN_FLIGHT * RESPONSE_SIZE];
+  gboolean broken;
+
+  broken = FALSE;
+  g_mutex_lock(&conn->lock);
+  for(;;)
+    {
+      guint size;
+
+      while(conn->responses->len == 0 &&
+            !(conn->reading_done && conn->in_flight == 0))
+        g_cond_wait(&conn->ready, &conn->lock);
+      if(conn->responses->len == 0)
+        break;
+      size = conn->responses->len;
+      memcpy(batch, conn->responses->data, size);
+      g_byte_array_set_size(conn->responses, 0);
+      g_mutex_unlock(&conn->lock);
+
+      if(!broken && !write_full(conn->fd, batch, size))
+        {
+          broken = TRUE;
+          shutdown(conn->fd, SHUT_RDWR);
+        }
+
+      g_mutex_lock(&conn->lock);
+      conn->in_flight -= size / RESPONSE_SIZE;
+      g_cond_signal(&conn->drained);
+    }
+  g_mutex_unlock(&conn->lock);
+  return NULL;
+}
+
+static gpointer
+serve_connection(gpointer data)
+{
+  connection *conn = data;
+  guchar header[REQUEST_SIZE];
+  GThread *writer;
+
+  writer = g_thread_new("responses", write_responses, conn);
+  while(read_full(conn->fd, header, REQUEST_SIZE))
+    {
+      guint32 id, width, height, bits, stride;
+      job *j;
+
+      id = read_u32(header);
+      width = read_u32(header + 4);
+      height = read_u32(header + 8);
+      bits = read_u32(header + 12);
+      if((bits != 1 && bits != 8) ||
+         width == 0 || width > MAX_SIDE ||
+         height == 0 || height > MAX_SIDE)
+        {
+          g_printerr("bad request header, closing connection\n");
+          break;
+        }
+      stride = bits == 1 ? (width + 7) / 8 : width;
+
+      j = job_get((gsize)stride * height);
+      if(!read_full(conn->fd, j->buffer, (gsize)stride * height))
+        {
+          job_put(j);
+          break;
+        }
+      j->id = id;
+      j->plane.pixels = j->buffer;
+      j->plane.width = width;
+      j->plane.height = height;
+      j->plane.rowstride = stride;
+      j->plane.n_channels = 1;
+      j->plane.bits = bits;
+      j->plane.offset = 0;
+      j->conn = conn;
+      j->ring = NULL;
+
+      /* bound the pipeline so a fast client cannot queue unlimited
+       * frames */
+      g_mutex_lock(&conn->lock);
+      while(conn->in_flight >= MAX_IN_FLIGHT)
+        g_cond_wait(&conn->drained, &conn->lock);
+      conn->in_flight++;
+      g_mutex_unlock(&conn->lock);
+
+      g_atomic_int_inc(&conn->ref_count);
+      g_thread_pool_push(workers, j, NULL);
+    }
+
+  shutdown(conn->fd, SHUT_RD);
+  g_mutex_lock(&conn->lock);
+  conn->reading_done = TRUE;
+  g_cond_signal(&conn->ready);
+  g_mutex_unlock(&conn->lock);
+  g_thread_join(writer);
+  connection_unref(conn);
+  if(options.cache != NULL)
+    {
+      guint64 hits, misses;
+
+      hough_cache_stats(options.cache, &hits, &misses);
+      g_printerr("cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+                 " misses\n", hits, misses);
+    }
+  if(options.thin)
+    {
+      hough_stage_stats stats;
+
+      hough_thin_stats(&stats);
+      g_printerr("thinning: %" G_GUINT64_FORMAT " crops, %.1f ms, "
+                 "%" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT
+                 " dark pixels\n", stats.calls, stats.usec / 1e3,
+                 stats.pixels_in, stats.pixels_out);
+    }
+  return NULL;
+}
+
+static gpointer
+serve_ring(gpointer data)
+{
+  shm_ring *ring = data;
+
+  for(;;)
+    {
+      job *j = job_get(0);
+
+      shm_ring_next_request(ring, &j->slot, &j->id, &j->plane);
+      j->ring = ring;
+      j->conn = NULL;
+      g_thread_pool_push(workers, j, NULL);
+    }
+  return NULL;
+}
+
+static int
+listen_socket(const gchar *path)
+{
+  struct sockaddr_un address;
+  int fd;
+
+  if(strlen(path) >= sizeof(address.sun_path))
+    {
+      g_printerr("%s: socket path is too long\n", path);
+      return -1;
+    }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    {
+      g_printerr("socket: %s\n", g_strerror(errno));
+      return -1;
+    }
+  unlink(path);
+  if(bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+     listen(fd, SOMAXCONN) < 0)
+    {
+      g_printerr("%s: %s\n", path, g_strerror(errno));
+      close(fd);
+      return -1;
+    }
+  return fd;
+}
+
+int main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error;
+  int fd;
+
+  error = NULL;
+  context = g_option_context_new("- digit recognition daemon");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if(!g_option_context_parse(context, &argc, &argv, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(context);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free(context);
+
+  if(pyramid < 0 || height < 0 || n_threads < 0 || cache_mb < 0)
+    {
+      g_printerr("--pyramid, --height, --threads and --cache-mb "
+                 "must not be negative\n");
+      return EXIT_FAILURE;
+    }
+  if(ring_slots <= 0 || ring_slot_size <= 0)
+    {
+      g_printerr("--slots and --slot-size must be positive\n");
+      return EXIT_FAILURE;
+    }
+
+  hough_options_init(&options);
+  options.pyramid_factor = pyramid;
+  options.canonical_height = height;
+  options.vote_mode = oriented ? HOUGH_VOTE_ORIENTED :
+      sampled ? HOUGH_VOTE_SAMPLED : HOUGH_VOTE_FULL;
+  options.classifier = template ? HOUGH_CLASSIFY_TEMPLATE :
+      HOUGH_CLASSIFY_LINES;
+  options.thin = thin;
+  options.arcs = arcs;
+  options.deskew = deskew;
+  options.open_radius = open_radius;
+  options.close_radius = close_radius;
+  if(cache_mb > 0)
+    options.cache = hough_cache_new((gsize)cache_mb * 1024 * 1024);
+
+  /* worker threads are started up front, not on the first request */
+  if(n_threads == 0)
+    n_threads = g_get_num_processors();
+  workers = g_thread_pool_new(recognize_job, NULL, n_threads, TRUE, &error);
+  if(workers == NULL)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+  fd = listen_socket(socket_path);
+  if(fd < 0)
+    return EXIT_FAILURE;
+  signal(SIGPIPE, SIG_IGN);
+
+  if(shm_name != NULL)
+    {
+      shm_ring *ring;
+
+      ring = shm_ring_create(shm_name, ring_slots, ring_slot_size, &error);
+      if(ring == NULL)
+        {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+          close(fd);
+          return EXIT_FAILURE;
+        }
+      g_thread_unref(g_thread_new("ring", serve_ring, ring));
+    }
+
+  for(;;)
+    {
+      connection *conn;
+      int client;
+
+      client = accept(fd, NULL, NULL);
+      if(client < 0)
+        {
+          if(errno == EINTR || errno == ECONNABORTED)
+            continue;
+          g_printerr("accept: %s\n", g_strerror(errno));
+          break;
+        }
+
+      conn = g_new0(connection, 1);
+      conn->fd = client;
+      conn->ref_count = 1;
+      conn->responses = g_byte_array_new();
+      g_mutex_init(&conn->lock);
+      g_cond_init(&conn->drained);
+      g_cond_init(&conn->ready);
+      g_thread_unref(g_thread_new("connection", serve_connection, conn));
+    }
+
+  close(fd);
+  g_thread_pool_free(workers, FALSE, TRUE);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,303 @@
+#include <math.h>
+#include <string.h>
+#include "hough-arcs.h"
+
+/* centre cells across the smaller side */
+#define ARC_CELLS 24
+/* the smallest radius is the smaller side over this */
+#define ARC_MIN_RADIUS_RATIO 8
+#define ARC_PEAKS 4
+/* how closely the gradient of a supporting edge points at the centre */
+#define ARC_RADIAL_COS 0.9
+#define ARC_BINS 36
+#define ARC_MIN_SWEEP 90
+/* supporting edges per pixel of arc length */
+#define ARC_MIN_FILL 0.5
+/* crops this much taller than wide are searched for a 0 too */
+#define ARC_TALL_ASPECT 1.25
+/* and such an ellipse must span this share of the height */
+#define ARC_TALL_SPAN 0.7
+
+typedef struct arc_space
+{
+  GArray *edges;
+  /* rows are divided by it */
+  double aspect;
+  int width;
+  int height;
+  int min_radius;
+  int max_radius;
+  int cell;
+  /* votes land in cells, so radii are stepped by about half a cell */
+  int radius_step;
+  int cells_x;
+  int cells_y;
+  int *votes;
+} arc_space;
+
+/* Unit gradient of the edge in the squeezed space, FALSE without one */
+static gboolean
+edge_normal(const arc_space *space, const hough_edge *edge,
+            double *ux, double *uy)
+{
+  double nx, ny, norm;
+
+  nx = edge->gx;
+  ny = edge->gy * space->aspect;
+  norm = sqrt(nx * nx + ny * ny);
+  if(norm == 0)
+    return FALSE;
+  *ux = nx / norm;
+  *uy = ny / norm;
+  return TRUE;
+}
+
+/* The outer edge of a stroke has the centre ahead of its gradient, the
+ * inner one behind, so both ways are voted */
+static void
+vote_centres(arc_space *space)
+{
+  for(guint k = 0; k < space->edges->len; ++k)
+    {
+      const hough_edge *edge = &g_array_index(space->edges, hough_edge, k);
+      double ux, uy, px, py;
+
+      if(!edge_normal(space, edge, &ux, &uy))
+        continue;
+      px = edge->x / (double)space->cell;
+      py = edge->y / space->aspect / space->cell;
+      ux /= space->cell;
+      uy /= space->cell;
+      for(int r = space->min_radius; r <= space->max_radius;
+          r += space->radius_step)
+        for(int sign = -1; sign <= 1; sign += 2)
+          {
+            double cx = px + sign * r * ux, cy = py + sign * r * uy;
+
+            if(cx < 0 || cx >= space->cells_x || cy < 0 || cy >= space->cells_y)
+              continue;
+            space->votes[(int)cy * space->cells_x + (int)cx]++;
+          }
+    }
+}
+
+/* Longest circular run of covered bins */
+static void
+longest_cover(const gboolean *covered, int *start, int *length)
+{
+  int best, best_start, run;
+
+  best = 0;
+  best_start = 0;
+  run = 0;
+  for(int k = 0; k < 2 * ARC_BINS && best < ARC_BINS; ++k)
+    {
+      run = covered[k % ARC_BINS] ? run + 1 : 0;
+      if(run > best)
+        {
+          best = MIN(run, ARC_BINS);
+          best_start = k - run + 1;
+        }
+    }
+  *start = best_start % ARC_BINS;
+  *length = best;
+}
+
+/* Reads radius and sweep off the edges around the centre (cx, cy) of
+ * the squeezed space. FALSE if they do not make an arc. */
+static gboolean
+measure_arc(const arc_space *space, double cx, double cy, hough_arc *arc)
+{
+  int counts[ARC_BINS];
+  gboolean covered[ARC_BINS];
+  int *histogram;
+  int radius, tolerance, best, points, start, length;
+
+  histogram = g_new0(int, space->max_radius + 1);
+  for(guint k = 0; k < space->edges->len; ++k)
+    {
+      const hough_edge *edge = &g_array_index(space->edges, hough_edge, k);
+      double ux, uy, dx, dy, d;
+
+      if(!edge_normal(space, edge, &ux, &uy))
+        continue;
+      dx = edge->x - cx;
+      dy = edge->y / space->aspect - cy;
+      d = sqrt(dx * dx + dy * dy);
+      if(d < space->min_radius || d > space->max_radius ||
+         fabs(dx * ux + dy * uy) < ARC_RADIAL_COS * d)
+        continue;
+      histogram[(int)d]++;
+    }
+
+  /* both edges of the stroke fall within the tolerance, also when the
+   * rows are squeezed and the stroke looks thinner across them */
+  tolerance = MAX(2, space->max_radius / 8);
+  radius = space->min_radius;
+  best = -1;
+  for(int r = space->min_radius; r <= space->max_radius; ++r)
+    {
+      int sum = 0;
+
+      for(int d = MAX(0, r - tolerance);
+          d <= MIN(space->max_radius, r + tolerance); ++d)
+        sum += histogram[d];
+      if(sum > best)
+        {
+          best = sum;
+          radius = r;
+        }
+    }
+  g_free(histogram);
+
+  memset(counts, 0, sizeof(counts));
+  points = 0;
+  for(guint k = 0; k < space->edges->len; ++k)
+    {
+      const hough_edge *edge = &g_array_index(space->edges, hough_edge, k);
+      double ux, uy, dx, dy, d, angle;
+
+      if(!edge_normal(space, edge, &ux, &uy))
+        continue;
+      dx = edge->x - cx;
+      dy = edge->y / space->aspect - cy;
+      d = sqrt(dx * dx + dy * dy);
+      if(fabs(d - radius) > tolerance ||
+         fabs(dx * ux + dy * uy) < ARC_RADIAL_COS * d)
+        continue;
+      angle = atan2(dy, dx) * 180 / M_PI;
+      if(angle < 0)
+        angle += 360;
+      counts[MIN(ARC_BINS - 1, (int)(angle * ARC_BINS / 360))]++;
+      points++;
+    }
+  /* a few stray edges, of specks for instance, do not cover a bin */
+  for(int b = 0; b < ARC_BINS; ++b)
+    covered[b] = counts[b] >= ARC_MIN_FILL * radius * 2 * M_PI / ARC_BINS;
+
+  longest_cover(covered, &start, &length);
+  arc->cx = (int)round(cx);
+  arc->cy = (int)round(cy * space->aspect);
+  arc->radius_x = radius;
+  arc->radius_y = (int)round(radius * space->aspect);
+  arc->start = start * 360 / ARC_BINS;
+  arc->sweep = length * 360 / ARC_BINS;
+  arc->points = points;
+  return arc->sweep >= ARC_MIN_SWEEP &&
+      points >= ARC_MIN_FILL * radius * arc->sweep * M_PI / 180;
+}
+
+/* Centre of the votes around the cell, in the squeezed space */
+static void
+peak_centre(const arc_space *space, int peak, double *cx, double *cy)
+{
+  double sum, sx, sy;
+  int px, py;
+
+  px = peak % space->cells_x;
+  py = peak / space->cells_x;
+  sum = sx = sy = 0;
+  for(int y = MAX(0, py - 1); y <= MIN(space->cells_y - 1, py + 1); ++y)
+    for(int x = MAX(0, px - 1); x <= MIN(space->cells_x - 1, px + 1); ++x)
+      {
+        int votes = space->votes[y * space->cells_x + x];
+
+        sum += votes;
+        sx += votes * (x + 0.5);
+        sy += votes * (y + 0.5);
+      }
+  *cx = sx / sum * space->cell;
+  *cy = sy / sum * space->cell;
+}
+
+static void
+find_arcs(GArray *edges, int width, int height, double aspect,
+          GArray *arcs)
+{
+  arc_space space;
+
+  space.edges = edges;
+  space.aspect = aspect;
+  space.width = width;
+  space.height = MAX(1, (int)(height / aspect));
+  space.min_radius = MAX(2, MIN(space.width, space.height) /
+                         ARC_MIN_RADIUS_RATIO);
+  space.max_radius = MAX(space.width, space.height) / 2;
+  space.cell = MAX(1, MIN(space.width, space.height) / ARC_CELLS);
+  space.radius_step = MAX(1, space.cell / 2);
+  space.cells_x = (space.width + space.cell - 1) / space.cell;
+  space.cells_y = (space.height + space.cell - 1) / space.cell;
+  if(space.max_radius < space.min_radius)
+    return;
+  space.votes = g_new0(int, space.cells_x * space.cells_y);
+  vote_centres(&space);
+
+  for(int n = 0; n < ARC_PEAKS; ++n)
+    {
+      hough_arc arc;
+      double cx, cy;
+      int peak = 0, suppress;
+
+      for(int c = 1; c < space.cells_x * space.cells_y; ++c)
+        if(space.votes[c] > space.votes[peak])
+          peak = c;
+      /* a full circle of the smallest radius votes 2 pi times more */
+      if(space.votes[peak] * space.radius_step < space.min_radius)
+        break;
+
+      /* the votes of a found arc spread over about half its radius */
+      peak_centre(&space, peak, &cx, &cy);
+      suppress = space.min_radius;
+      if(measure_arc(&space, cx, cy, &arc))
+        {
+          g_array_append_val(arcs, arc);
+          suppress = MAX(suppress, arc.radius_x / 2);
+        }
+      suppress = MAX(1, suppress / space.cell);
+
+      for(int y = MAX(0, peak / space.cells_x - suppress);
+          y <= MIN(space.cells_y - 1, peak / space.cells_x + suppress); ++y)
+        for(int x = MAX(0, peak % space.cells_x - suppress);
+            x <= MIN(space.cells_x - 1, peak % space.cells_x + suppress);
+            ++x)
+          space.votes[y * space.cells_x + x] = 0;
+    }
+  g_free(space.votes);
+}
+
+GArray*
+detect_arcs(GArray *edges, int width, int height)
+{
+  GArray *arcs, *tall;
+
+  arcs = g_array_new(FALSE, FALSE, sizeof (hough_arc));
+  find_arcs(edges, width, height, 1.0, arcs);
+  if(height <= width * ARC_TALL_ASPECT)
+    return arcs;
+
+  tall = g_array_new(FALSE, FALSE, sizeof (hough_arc));
+  find_arcs(edges, width, height, (double)height / width, tall);
+  for(guint k = 0; k < tall->len; ++k)
+    {
+      hough_arc *arc = &g_array_index(tall, hough_arc, k);
+      hough_arc *same = NULL;
+
+      if(2 * arc->radius_y < height * ARC_TALL_SPAN)
+        continue;
+      /* a circle around the same centre is a poorer fit of it */
+      for(guint n = 0; n < arcs->len; ++n)
+        {
+          hough_arc *other = &g_array_index(arcs, hough_arc, n);
+
+          if(abs(other->cx - arc->cx) < arc->radius_x / 2 &&
+             abs(other->cy - arc->cy) < arc->radius_x / 2)
+            same = other;
+        }
+      if(same == NULL)
+        g_array_append_val(arcs, *arc);
+      else if(arc->sweep > same->sweep)
+        *same = *arc;
+    }
+  g_array_free(tall, TRUE);
+  return arcs;
+}
@@ -0,0 +1,33 @@
+#ifndef HOUGHARCS_H
+#define HOUGHARCS_H
+
+#include <glib.h>
+#include "hough-plane.h"
+
+/* Circular arcs of a cropped digit. Every edge pixel votes for the
+ * centres lying along its gradient, at each radius in range, in a 2D
+ * accumulator of centres, so the cost grows with the radius range like
+ * the line transform grows with the angles, not with a third dimension.
+ * The radius and the sweep of each strong centre are then read off the
+ * edges around it. Ellipses as tall as the crop, the bowl of a 0, are
+ * looked for the same way with the rows squeezed to a square. */
+
+typedef struct hough_arc
+{
+  int cx;
+  int cy;
+  int radius_x;
+  int radius_y;
+  /* degrees clockwise from the right, as seen on the image */
+  int start;
+  int sweep;
+  /* edge pixels on the arc */
+  int points;
+} hough_arc;
+
+/* hough_arc found among the hough_plane_edges() of a width x height
+ * crop, circles by their votes, then the tall ellipse */
+GArray*
+detect_arcs(GArray *edges, int width, int height);
+
+#endif // HOUGHARCS_H
@@ -0,0 +1,140 @@
+#include "hough-bands.h"
+
+/* bands per processor, so that a slow band does not hold up the rest */
+#define BANDS_PER_THREAD 4
+
+typedef struct band_job
+{
+  hough_band_func func;
+  gpointer data;
+  int n_rows;
+  int n_bands;
+  gint next;
+  /* held by the caller and by every task pushed, a task may start
+   * after the caller has returned */
+  gint refs;
+  int n_done;
+  GMutex lock;
+  GCond cond;
+} band_job;
+
+static GThreadPool *pool;
+static int n_threads;
+
+static void
+band_rows(int n_rows, int n_bands, int band, int *first, int *last)
+{
+  *first = (gint64)band * n_rows / n_bands;
+  *last = (gint64)(band + 1) * n_rows / n_bands;
+}
+
+static void
+run_bands(band_job *job)
+{
+  int band, n_done;
+
+  n_done = 0;
+  while((band = g_atomic_int_add(&job->next, 1)) < job->n_bands)
+    {
+      int first, last;
+
+      band_rows(job->n_rows, job->n_bands, band, &first, &last);
+      job->func(band, first, last, job->data);
+      n_done++;
+    }
+  if(n_done > 0)
+    {
+      g_mutex_lock(&job->lock);
+      job->n_done += n_done;
+      if(job->n_done == job->n_bands)
+        g_cond_signal(&job->cond);
+      g_mutex_unlock(&job->lock);
+    }
+}
+
+static void
+unref_job(band_job *job)
+{
+  if(g_atomic_int_dec_and_test(&job->refs))
+    {
+      g_mutex_clear(&job->lock);
+      g_cond_clear(&job->cond);
+      g_free(job);
+    }
+}
+
+static void
+band_task(gpointer data,
+          gpointer unused)
+{
+  run_bands(data);
+  unref_job(data);
+}
+
+static gpointer
+create_pool(gpointer unused)
+{
+  n_threads = g_get_num_processors();
+  /* the caller makes up the last thread */
+  if(n_threads > 1)
+    pool = g_thread_pool_new(band_task, NULL, n_threads - 1, FALSE, NULL);
+  return NULL;
+}
+
+static void
+init_pool(void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once(&once, create_pool, NULL);
+}
+
+int
+hough_bands_count(int n_rows,
+                  int min_rows)
+{
+  init_pool();
+  return CLAMP(n_rows / MAX(min_rows, 1), 1, n_threads * BANDS_PER_THREAD);
+}
+
+void
+hough_bands_run(int n_rows,
+                int n_bands,
+                hough_band_func func,
+                gpointer data)
+{
+  band_job *job;
+  int n_tasks;
+
+  init_pool();
+  n_tasks = pool != NULL ? MIN(n_bands, n_threads) - 1 : 0;
+  if(n_tasks <= 0)
+    {
+      for(int band = 0; band < n_bands; ++band)
+        {
+          int first, last;
+
+          band_rows(n_rows, n_bands, band, &first, &last);
+          func(band, first, last, data);
+        }
+      return;
+    }
+
+  job = g_new0(band_job, 1);
+  job->func = func;
+  job->data = data;
+  job->n_rows = n_rows;
+  job->n_bands = n_bands;
+  job->refs = n_tasks + 1;
+  g_mutex_init(&job->lock);
+  g_cond_init(&job->cond);
+  for(int k = 0; k < n_tasks; ++k)
+    g_thread_pool_push(pool, job, NULL);
+
+  run_bands(job);
+  g_mutex_lock(&job->lock);
+  while(job->n_done < job->n_bands)
+    g_cond_wait(&job->cond, &job->lock);
+  g_mutex_unlock(&job->lock);
+  unref_job(job);
+}
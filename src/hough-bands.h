@@ -0,0 +1,28 @@
+#ifndef HOUGHBANDS_H
+#define HOUGHBANDS_H
+
+#include <glib.h>
+
+/* Row bands of an image worked on by a thread pool the whole process
+ * shares, one thread per processor. The calling thread takes bands as
+ * well, so a call made from a busy pool or from several threads at once
+ * still finishes. */
+
+/* Rows first to last - 1 of band number band */
+typedef void (*hough_band_func)(int band, int first, int last,
+                                gpointer data);
+
+/* Number of bands to split n_rows into: a few per processor, none
+ * smaller than min_rows */
+int
+hough_bands_count(int n_rows, int min_rows);
+
+/* Calls func on n_bands bands of n_rows, as even as they go, and
+ * returns when all are done */
+void
+hough_bands_run(int n_rows,
+                int n_bands,
+                hough_band_func func,
+                gpointer data);
+
+#endif // HOUGHBANDS_H
@@ -0,0 +1,175 @@
+#include "hough-cache.h"
+
+#define CACHE_SHARDS 16
+/* an entry plus its hash table node */
+#define ENTRY_COST (sizeof(cache_entry) + 4 * sizeof(gpointer))
+
+typedef struct cache_entry
+{
+  guint64 key;
+  int digit;
+  double confidence;
+  struct cache_entry *newer;
+  struct cache_entry *older;
+} cache_entry;
+
+typedef struct cache_shard
+{
+  GMutex lock;
+  GHashTable *entries;
+  /* most and least recently used */
+  cache_entry *newest;
+  cache_entry *oldest;
+  guint size;
+  guint capacity;
+  guint64 hits;
+  guint64 misses;
+} cache_shard;
+
+struct hough_cache
+{
+  cache_shard shards[CACHE_SHARDS];
+};
+
+static cache_shard*
+shard_of(hough_cache *cache, guint64 key)
+{
+  /* the low bits pick the hash table bucket, use the high ones here */
+  return &cache->shards[(key >> 56) % CACHE_SHARDS];
+}
+
+static void
+unlink_entry(cache_shard *shard, cache_entry *entry)
+{
+  if(entry->newer != NULL)
+    entry->newer->older = entry->older;
+  else
+    shard->newest = entry->older;
+  if(entry->older != NULL)
+    entry->older->newer = entry->newer;
+  else
+    shard->oldest = entry->newer;
+}
+
+static void
+push_newest(cache_shard *shard, cache_entry *entry)
+{
+  entry->newer = NULL;
+  entry->older = shard->newest;
+  if(shard->newest != NULL)
+    shard->newest->newer = entry;
+  shard->newest = entry;
+  if(shard->oldest == NULL)
+    shard->oldest = entry;
+}
+
+hough_cache*
+hough_cache_new(gsize max_bytes)
+{
+  hough_cache *cache;
+  guint capacity;
+
+  cache = g_new0(hough_cache, 1);
+  capacity = MAX(1, max_bytes / ENTRY_COST / CACHE_SHARDS);
+  for(int i = 0; i < CACHE_SHARDS; ++i)
+    {
+      cache_shard *shard = &cache->shards[i];
+
+      g_mutex_init(&shard->lock);
+      shard->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             NULL, g_free);
+      shard->capacity = capacity;
+    }
+  return cache;
+}
+
+void
+hough_cache_free(hough_cache *cache)
+{
+  for(int i = 0; i < CACHE_SHARDS; ++i)
+    {
+      g_hash_table_destroy(cache->shards[i].entries);
+      g_mutex_clear(&cache->shards[i].lock);
+    }
+  g_free(cache);
+}
+
+gboolean
+hough_cache_lookup(hough_cache *cache,
+                   guint64 key,
+                   int *digit,
+                   double *confidence)
+{
+  cache_shard *shard;
+  cache_entry *entry;
+
+  shard = shard_of(cache, key);
+  g_mutex_lock(&shard->lock);
+  entry = g_hash_table_lookup(shard->entries, &key);
+  if(entry != NULL)
+    {
+      unlink_entry(shard, entry);
+      push_newest(shard, entry);
+      *digit = entry->digit;
+      *confidence = entry->confidence;
+      shard->hits++;
+    }
+  else
+    shard->misses++;
+  g_mutex_unlock(&shard->lock);
+
+  return entry != NULL;
+}
+
+void
+hough_cache_insert(hough_cache *cache,
+                   guint64 key,
+                   int digit,
+                   double confidence)
+{
+  cache_shard *shard;
+  cache_entry *entry;
+
+  shard = shard_of(cache, key);
+  g_mutex_lock(&shard->lock);
+  entry = g_hash_table_lookup(shard->entries, &key);
+  if(entry != NULL)
+    unlink_entry(shard, entry);
+  else
+    {
+      if(shard->size == shard->capacity)
+        {
+          cache_entry *oldest = shard->oldest;
+
+          unlink_entry(shard, oldest);
+          g_hash_table_remove(shard->entries, &oldest->key);
+          shard->size--;
+        }
+      entry = g_new(cache_entry, 1);
+      entry->key = key;
+      g_hash_table_insert(shard->entries, &entry->key, entry);
+      shard->size++;
+    }
+  entry->digit = digit;
+  entry->confidence = confidence;
+  push_newest(shard, entry);
+  g_mutex_unlock(&shard->lock);
+}
+
+void
+hough_cache_stats(hough_cache *cache,
+                  guint64 *hits,
+                  guint64 *misses)
+{
+  *hits = 0;
+  *misses = 0;
+  for(int i = 0; i < CACHE_SHARDS; ++i)
+    {
+      cache_shard *shard = &cache->shards[i];
+
+      g_mutex_lock(&shard->lock);
+      *hits += shard->hits;
+      *misses += shard->misses;
+      g_mutex_unlock(&shard->lock);
+    }
+}
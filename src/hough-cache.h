@@ -0,0 +1,35 @@
+#ifndef HOUGHCACHE_H
+#define HOUGHCACHE_H
+
+#include <glib.h>
+
+/* Bounded LRU map from a crop hash to its recognition result. Keys are
+ * spread over independently locked shards, so recognition threads
+ * rarely wait for each other. */
+
+typedef struct hough_cache hough_cache;
+
+hough_cache*
+hough_cache_new(gsize max_bytes);
+
+void
+hough_cache_free(hough_cache *cache);
+
+gboolean
+hough_cache_lookup(hough_cache *cache,
+                   guint64 key,
+                   int *digit,
+                   double *confidence);
+
+void
+hough_cache_insert(hough_cache *cache,
+                   guint64 key,
+                   int digit,
+                   double confidence);
+
+void
+hough_cache_stats(hough_cache *cache,
+                  guint64 *hits,
+                  guint64 *misses);
+
+#endif // HOUGHCACHE_H
@@ -0,0 +1,441 @@
+#include "hough-dump.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define HEADER_SIZE 5
+#define RECORD_TAG 'R'
+#define MILLION 1e6
+/* anything larger is a damaged dump */
+#define MAX_LABEL 4096
+#define MAX_ITEMS (1 << 20)
+#define MAX_VOTES (1 << 26)
+
+struct hough_dump
+{
+  gchar *path;
+#ifdef HAVE_ZLIB
+  gzFile file;
+#else
+  FILE *file;
+#endif
+  GMutex lock;
+  /* a write went wrong, later records would not line up */
+  gboolean failed;
+  /* the record being read ran out or made no sense */
+  gboolean broken;
+};
+
+G_DEFINE_QUARK(dump-error-quark, dump_error)
+
+static gboolean
+put_bytes(hough_dump *dump, const void *data, gsize size)
+{
+#ifdef HAVE_ZLIB
+  return size == 0 || gzwrite(dump->file, data, size) == (int)size;
+#else
+  return fwrite(data, 1, size, dump->file) == size;
+#endif
+}
+
+static int
+get_byte(hough_dump *dump)
+{
+  int c;
+
+#ifdef HAVE_ZLIB
+  c = gzgetc(dump->file);
+#else
+  c = getc(dump->file);
+#endif
+  if(c < 0)
+    dump->broken = TRUE;
+  return c;
+}
+
+static void
+put_varint(GByteArray *out, guint64 value)
+{
+  do
+    {
+      guint8 byte = value & 0x7f;
+
+      value >>= 7;
+      if(value != 0)
+        byte |= 0x80;
+      g_byte_array_append(out, &byte, 1);
+    }
+  while(value != 0);
+}
+
+static void
+put_int(GByteArray *out, gint64 value)
+{
+  put_varint(out, ((guint64)value << 1) ^ (guint64)(value >> 63));
+}
+
+static guint64
+get_varint(hough_dump *dump)
+{
+  guint64 value;
+
+  value = 0;
+  for(int shift = 0; shift < 64 && !dump->broken; shift += 7)
+    {
+      int c = get_byte(dump);
+
+      if(c < 0)
+        break;
+      value |= (guint64)(c & 0x7f) << shift;
+      if((c & 0x80) == 0)
+        return value;
+    }
+  dump->broken = TRUE;
+  return 0;
+}
+
+static gint64
+get_int(hough_dump *dump)
+{
+  guint64 value = get_varint(dump);
+
+  return (gint64)(value >> 1) ^ -(gint64)(value & 1);
+}
+
+/* Zero runs, then counts as differences; a lone zero among counts is
+ * cheaper kept as a count */
+static void
+put_votes(GByteArray *out, const int *votes, int n_votes)
+{
+  int k = 0;
+
+  while(k < n_votes)
+    {
+      int zeros, start, previous;
+
+      for(zeros = 0; k < n_votes && votes[k] == 0; ++k)
+        zeros++;
+      start = k;
+      while(k < n_votes &&
+            (votes[k] != 0 || (k + 1 < n_votes && votes[k + 1] != 0)))
+        k++;
+      put_varint(out, zeros);
+      put_varint(out, k - start);
+      previous = 0;
+      for(int j = start; j < k; ++j)
+        {
+          put_int(out, votes[j] - previous);
+          previous = votes[j];
+        }
+    }
+}
+
+static void
+get_votes(hough_dump *dump, int *votes, int n_votes)
+{
+  int k = 0;
+
+  while(k < n_votes && !dump->broken)
+    {
+      guint64 zeros, count;
+      int previous;
+
+      zeros = get_varint(dump);
+      count = get_varint(dump);
+      if(zeros + count > (guint64)(n_votes - k) || zeros + count == 0)
+        {
+          dump->broken = TRUE;
+          break;
+        }
+      k += zeros;
+      previous = 0;
+      for(guint64 j = 0; j < count; ++j)
+        {
+          previous += get_int(dump);
+          votes[k++] = previous;
+        }
+    }
+}
+
+static hough_dump*
+open_file(const gchar *path, const gchar *mode, GError **error)
+{
+  hough_dump *dump;
+
+  dump = g_new0(hough_dump, 1);
+#ifdef HAVE_ZLIB
+  dump->file = gzopen(path, mode);
+#else
+  dump->file = fopen(path, mode);
+#endif
+  if(dump->file == NULL)
+    {
+      g_set_error(error, DUMP_ERROR, DUMP_ERROR_IO,
+                  "%s: %s", path, g_strerror(errno));
+      g_free(dump);
+      return NULL;
+    }
+  dump->path = g_strdup(path);
+  g_mutex_init(&dump->lock);
+  return dump;
+}
+
+hough_dump*
+hough_dump_create(const gchar *path,
+                  gboolean compress,
+                  GError **error)
+{
+  hough_dump *dump;
+  guint8 header[HEADER_SIZE];
+
+#ifdef HAVE_ZLIB
+  /* "T" writes gzopen()'s plain output */
+  dump = open_file(path, compress ? "wb" : "wbT", error);
+#else
+  if(compress)
+    {
+      g_set_error(error, DUMP_ERROR, DUMP_ERROR_UNSUPPORTED,
+                  "%s: built without zlib, cannot compress", path);
+      return NULL;
+    }
+  dump = open_file(path, "wb", error);
+#endif
+  if(dump == NULL)
+    return NULL;
+  memcpy(header, DUMP_MAGIC, 4);
+  header[4] = DUMP_VERSION;
+  dump->failed = !put_bytes(dump, header, HEADER_SIZE);
+  return dump;
+}
+
+gboolean
+hough_dump_write(hough_dump *dump,
+                 const gchar *label,
+                 const hough_result *result,
+                 GError **error)
+{
+  GByteArray *out;
+  guint8 tag = RECORD_TAG;
+  guint n_lines, n_arcs;
+  gsize length;
+  gboolean ok;
+
+  out = g_byte_array_new();
+  length = strlen(label);
+  g_byte_array_append(out, &tag, 1);
+  put_varint(out, length);
+  g_byte_array_append(out, (const guint8*)label, length);
+  put_int(out, result->digit);
+  put_int(out, lround(result->confidence * MILLION));
+  put_int(out, result->skew);
+  put_varint(out, result->angle_step);
+  put_varint(out, result->crop_width);
+  put_varint(out, result->crop_height);
+
+  n_lines = result->lines != NULL ? result->lines->len : 0;
+  put_varint(out, n_lines);
+  for(guint k = 0; k < n_lines; ++k)
+    {
+      const hough_segment *line = &g_array_index(result->lines,
+                                                 hough_segment, k);
+
+      put_int(out, line->angle);
+      put_int(out, line->dist);
+      put_int(out, line->x0);
+      put_int(out, line->y0);
+      put_int(out, line->x1);
+      put_int(out, line->y1);
+      put_int(out, line->length);
+      put_int(out, line->points);
+    }
+  n_arcs = result->arcs != NULL ? result->arcs->len : 0;
+  put_varint(out, n_arcs);
+  for(guint k = 0; k < n_arcs; ++k)
+    {
+      const hough_arc *arc = &g_array_index(result->arcs, hough_arc, k);
+
+      put_int(out, arc->cx);
+      put_int(out, arc->cy);
+      put_int(out, arc->radius_x);
+      put_int(out, arc->radius_y);
+      put_int(out, arc->start);
+      put_int(out, arc->sweep);
+      put_int(out, arc->points);
+    }
+
+  if(result->votes == NULL)
+    {
+      put_varint(out, 0);
+      put_varint(out, 0);
+    }
+  else
+    {
+      put_varint(out, result->votes_width);
+      put_varint(out, result->votes_height);
+      put_int(out, lround(result->votes_scale * MILLION));
+      put_votes(out, result->votes,
+                result->votes_width * result->votes_height);
+    }
+
+  g_mutex_lock(&dump->lock);
+  ok = !dump->failed && put_bytes(dump, out->data, out->len);
+  dump->failed = !ok;
+  g_mutex_unlock(&dump->lock);
+  g_byte_array_unref(out);
+  if(!ok)
+    g_set_error(error, DUMP_ERROR, DUMP_ERROR_IO,
+                "%s: could not write the record of %s", dump->path, label);
+  return ok;
+}
+
+hough_dump*
+hough_dump_open(const gchar *path,
+                GError **error)
+{
+  hough_dump *dump;
+  guint8 header[HEADER_SIZE];
+
+  dump = open_file(path, "rb", error);
+  if(dump == NULL)
+    return NULL;
+  for(int k = 0; k < HEADER_SIZE; ++k)
+    header[k] = get_byte(dump);
+  if(dump->broken || memcmp(header, DUMP_MAGIC, 4) != 0 ||
+     header[4] != DUMP_VERSION)
+    {
+      g_set_error(error, DUMP_ERROR, DUMP_ERROR_FORMAT,
+                  "%s: not an accumulator dump", path);
+      hough_dump_close(dump, NULL);
+      return NULL;
+    }
+  return dump;
+}
+
+gboolean
+hough_dump_read(hough_dump *dump,
+                hough_dump_record *record,
+                GError **error)
+{
+  hough_result *result = &record->result;
+  guint64 length, n_lines, n_arcs, width, height;
+
+  memset(record, 0, sizeof(hough_dump_record));
+  if(get_byte(dump) != RECORD_TAG)
+    {
+      /* nothing after the last record is the end */
+      if(dump->broken)
+        return FALSE;
+      g_set_error(error, DUMP_ERROR, DUMP_ERROR_FORMAT,
+                  "%s: damaged record", dump->path);
+      return FALSE;
+    }
+
+  length = get_varint(dump);
+  if(length > MAX_LABEL)
+    dump->broken = TRUE;
+  else
+    {
+      record->label = g_malloc(length + 1);
+      for(guint64 k = 0; k < length; ++k)
+        record->label[k] = get_byte(dump);
+      record->label[length] = '\0';
+    }
+  result->digit = get_int(dump);
+  result->confidence = get_int(dump) / MILLION;
+  result->skew = get_int(dump);
+  result->angle_step = get_varint(dump);
+  result->crop_width = get_varint(dump);
+  result->crop_height = get_varint(dump);
+
+  n_lines = get_varint(dump);
+  if(n_lines > MAX_ITEMS)
+    dump->broken = TRUE;
+  result->lines = g_array_new(FALSE, FALSE, sizeof (hough_segment));
+  for(guint64 k = 0; k < n_lines && !dump->broken; ++k)
+    {
+      hough_segment line;
+
+      line.angle = get_int(dump);
+      line.dist = get_int(dump);
+      line.x0 = get_int(dump);
+      line.y0 = get_int(dump);
+      line.x1 = get_int(dump);
+      line.y1 = get_int(dump);
+      line.length = get_int(dump);
+      line.points = get_int(dump);
+      g_array_append_val(result->lines, line);
+    }
+  n_arcs = get_varint(dump);
+  if(n_arcs > MAX_ITEMS)
+    dump->broken = TRUE;
+  result->arcs = g_array_new(FALSE, FALSE, sizeof (hough_arc));
+  for(guint64 k = 0; k < n_arcs && !dump->broken; ++k)
+    {
+      hough_arc arc;
+
+      arc.cx = get_int(dump);
+      arc.cy = get_int(dump);
+      arc.radius_x = get_int(dump);
+      arc.radius_y = get_int(dump);
+      arc.start = get_int(dump);
+      arc.sweep = get_int(dump);
+      arc.points = get_int(dump);
+      g_array_append_val(result->arcs, arc);
+    }
+
+  width = get_varint(dump);
+  height = get_varint(dump);
+  if(width * height > MAX_VOTES || width > MAX_VOTES || height > MAX_VOTES)
+    dump->broken = TRUE;
+  else if(width * height > 0)
+    {
+      result->votes_width = width;
+      result->votes_height = height;
+      result->votes_scale = get_int(dump) / MILLION;
+      result->votes = calloc(width * height, sizeof (int));
+      get_votes(dump, result->votes, width * height);
+    }
+
+  if(dump->broken)
+    {
+      hough_dump_record_clear(record);
+      g_set_error(error, DUMP_ERROR, DUMP_ERROR_FORMAT,
+                  "%s: truncated or damaged record", dump->path);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+void
+hough_dump_record_clear(hough_dump_record *record)
+{
+  g_free(record->label);
+  record->label = NULL;
+  hough_result_clear(&record->result);
+}
+
+gboolean
+hough_dump_close(hough_dump *dump,
+                 GError **error)
+{
+  gboolean ok;
+
+#ifdef HAVE_ZLIB
+  ok = gzclose(dump->file) == Z_OK;
+#else
+  ok = fclose(dump->file) == 0;
+#endif
+  ok = ok && !dump->failed;
+  if(!ok)
+    g_set_error(error, DUMP_ERROR, DUMP_ERROR_IO,
+                "%s: could not write the dump", dump->path);
+  g_mutex_clear(&dump->lock);
+  g_free(dump->path);
+  g_free(dump);
+  return ok;
+}
@@ -0,0 +1,73 @@
+#ifndef HOUGHDUMP_H
+#define HOUGHDUMP_H
+
+#include <glib.h>
+#include "hough-recog.h"
+
+/* Recognition results with the accumulator they came from, for looking
+ * at the peaks offline. Layout, gzip-compressed or not:
+ *   header  "HDMP", version
+ *   record  'R', label, digit, confidence, skew, angle step, crop size,
+ *           lines, arcs, accumulator size and threshold scale, votes
+ * Numbers are LEB128 varints, signed ones zigzag coded, fractions in
+ * millionths. Votes go row by row as runs of zeros, each followed by a
+ * run of counts coded as differences from the one before. */
+
+#define DUMP_MAGIC "HDMP"
+#define DUMP_VERSION 1
+
+#define DUMP_ERROR (dump_error_quark())
+
+typedef enum
+{
+  DUMP_ERROR_FORMAT,
+  DUMP_ERROR_IO,
+  /* built without zlib */
+  DUMP_ERROR_UNSUPPORTED
+} DumpError;
+
+typedef struct hough_dump hough_dump;
+
+typedef struct hough_dump_record
+{
+  gchar *label;
+  hough_result result;
+} hough_dump_record;
+
+GQuark
+dump_error_quark(void);
+
+/* A new dump at path, gzip-compressed if compress */
+hough_dump*
+hough_dump_create(const gchar *path,
+                  gboolean compress,
+                  GError **error);
+
+/* Appends the result of recognizing label, any thread may call it */
+gboolean
+hough_dump_write(hough_dump *dump,
+                 const gchar *label,
+                 const hough_result *result,
+                 GError **error);
+
+/* A dump to read, compressed or not */
+hough_dump*
+hough_dump_open(const gchar *path,
+                GError **error);
+
+/* The next record, FALSE at the end or on error. Free it with
+ * hough_dump_record_clear(). */
+gboolean
+hough_dump_read(hough_dump *dump,
+                hough_dump_record *record,
+                GError **error);
+
+void
+hough_dump_record_clear(hough_dump_record *record);
+
+/* Flushes a created dump, FALSE if the data did not all get out */
+gboolean
+hough_dump_close(hough_dump *dump,
+                 GError **error);
+
+#endif // HOUGHDUMP_H
@@ -0,0 +1,202 @@
+#include "hough-pixbuf.h"
+#include <math.h>
+
+/* specks of noise() are 1/40 of the image side */
+#define SPECKLE_RATIO 80
+
+void
+hough_plane_from_pixbuf(const GdkPixbuf *image,
+                        hough_plane *plane)
+{
+  plane->pixels = gdk_pixbuf_get_pixels(image);
+  plane->width = gdk_pixbuf_get_width(image);
+  plane->height = gdk_pixbuf_get_height(image);
+  plane->rowstride = gdk_pixbuf_get_rowstride(image);
+  plane->n_channels = gdk_pixbuf_get_n_channels(image);
+  plane->bits = gdk_pixbuf_get_bits_per_sample(image);
+  plane->offset = 0;
+}
+
+int*
+accum_matrix_from_image_with_length(const GdkPixbuf *image,
+                                    int *matrix_width,
+                                    int *matrix_height)
+{
+  hough_plane plane;
+
+  hough_plane_from_pixbuf(image, &plane);
+  return accum_matrix_from_plane(&plane, matrix_width, matrix_height);
+}
+
+int
+identify_number(GdkPixbuf *image, GHashTable *table)
+{
+  return identify_number_by_size(gdk_pixbuf_get_width(image),
+                                 gdk_pixbuf_get_height(image),
+                                 table);
+}
+
+/* Paints the line x cos phi + y sin phi = rho red, a pixel per column
+ * if it runs more across than down, else a pixel per row */
+static void
+paint_line(GdkPixbuf *image, double phi, double rho)
+{
+  guchar *pixels;
+  int width, height, rowstride, n_channels;
+  double c, s;
+
+  pixels = gdk_pixbuf_get_pixels(image);
+  width = gdk_pixbuf_get_width(image);
+  height = gdk_pixbuf_get_height(image);
+  rowstride = gdk_pixbuf_get_rowstride(image);
+  n_channels = gdk_pixbuf_get_n_channels(image);
+  c = cos(phi);
+  s = sin(phi);
+  for(int k = 0; k < (fabs(s) >= fabs(c) ? width : height); ++k)
+    {
+      int x, y;
+      guchar *p;
+
+      if(fabs(s) >= fabs(c))
+        {
+          x = k;
+          y = (int)floor((rho - x * c) / s);
+        }
+      else
+        {
+          y = k;
+          x = (int)floor((rho - y * s) / c);
+        }
+      if(x < 0 || x >= width || y < 0 || y >= height)
+        continue;
+      p = pixels + y * rowstride + x * n_channels;
+      p[0] = 255;
+      p[1] = 0;
+      p[2] = 0;
+    }
+}
+
+void
+highlight(GdkPixbuf *image, GHashTable *table)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  int width, height, diag, max_distance;
+
+  /* the distance bins of accum_matrix_from_plane() on the image */
+  width = gdk_pixbuf_get_width(image);
+  height = gdk_pixbuf_get_height(image);
+  diag = round(sqrt((double)(width - 1) * (width - 1) +
+                    (double)(height - 1) * (height - 1)));
+  max_distance = round(sqrt(2) * diag);
+
+  g_hash_table_iter_init(&iter, table);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      double phi = GPOINTER_TO_INT(key) * M_PI / 180;
+
+      /* a bin holds the distances up to one pixel above its own */
+      for(GSList *line = value; line != NULL; line = line->next)
+        paint_line(image, phi,
+                   ((sl_value*)line->data)->bin - max_distance + 0.5);
+    }
+}
+
+int
+classify_pixbuf(const GdkPixbuf *image, hough_accum *accum)
+{
+  return classify_pixbuf_rect(image, accum, 0, 0,
+                              gdk_pixbuf_get_width(image),
+                              gdk_pixbuf_get_height(image));
+}
+
+/* Rectangle x, y, width, height grown by grow on each side, within the
+ * plane */
+static void
+grow_rect(const int *rect, int grow, const hough_plane *plane, int *grown)
+{
+  int right = MIN(rect[0] + rect[2] + grow, plane->width);
+  int bottom = MIN(rect[1] + rect[3] + grow, plane->height);
+
+  grown[0] = MAX(rect[0] - grow, 0);
+  grown[1] = MAX(rect[1] - grow, 0);
+  grown[2] = right - grown[0];
+  grown[3] = bottom - grown[1];
+}
+
+/* Only the part of the image the edit can reach is thresholded and
+ * cleaned. A changed pixel moves the threshold of the window around it,
+ * and opening and closing carry that twice their radius further; the
+ * pixels there in turn depend on four radii and a window around them.
+ * The window size is that of the whole image, so the result is the same
+ * as for the whole image. */
+int
+classify_pixbuf_rect(const GdkPixbuf *image, hough_accum *accum,
+                     int x, int y, int width, int height)
+{
+  hough_plane view, part, binary, cleaned, plane;
+  int changed[4], reach[4], clean[4], source[4];
+  int number, radius, window, half, accum_width, accum_height;
+  guchar *buffer, *cleaned_buffer, *pixels;
+
+  hough_plane_from_pixbuf(image, &view);
+  hough_accum_size(accum, &accum_width, &accum_height);
+  if(accum_width != view.width || accum_height != view.height)
+    {
+      x = y = 0;
+      width = view.width;
+      height = view.height;
+    }
+  if(width <= 0 || height <= 0)
+    return recognize_accum_rect(accum, &view, 0, 0, 0, 0, NULL);
+
+  window = MAX(MAX(view.width, view.height) / ADAPTIVE_WINDOW_RATIO, 1);
+  half = MAX(window / 2, 1);
+  radius = MIN(view.width, view.height) / SPECKLE_RATIO + 1;
+  changed[0] = x;
+  changed[1] = y;
+  changed[2] = width;
+  changed[3] = height;
+  grow_rect(changed, half + 4 * radius, &view, reach);
+  /* the accumulator compares whole words of the mask */
+  reach[2] = MIN((reach[0] + reach[2] + 63) & ~63, view.width) -
+      (reach[0] & ~63);
+  reach[0] &= ~63;
+  grow_rect(reach, 4 * radius, &view, clean);
+  grow_rect(clean, half, &view, source);
+
+  hough_plane_sub(&view, source[0], source[1], source[2], source[3], &part);
+  buffer = hough_plane_binarize_adaptive(&part, window, &binary);
+  hough_plane_sub(&binary, clean[0] - source[0], clean[1] - source[1],
+                  clean[2], clean[3], &part);
+  cleaned_buffer = hough_plane_clean(&part, radius, radius, &cleaned);
+
+  /* a plane of the whole image with only the reach filled in, the
+   * accumulator reads nothing else */
+  plane.width = view.width;
+  plane.height = view.height;
+  plane.rowstride = (view.width + 63) / 64 * 8;
+  plane.n_channels = 1;
+  plane.bits = 1;
+  plane.offset = 0;
+  pixels = g_malloc((gsize)plane.rowstride * plane.height);
+  plane.pixels = pixels;
+  for(int i = reach[1]; i < reach[1] + reach[3]; ++i)
+    for(int first = reach[0]; first < reach[0] + reach[2]; first += 64)
+      {
+        guint64 word = hough_plane_word(&cleaned, first - clean[0],
+                                        i - clean[1],
+                                        MIN(64, view.width - first));
+        guchar *bytes = pixels + (gsize)i * plane.rowstride + first / 8;
+
+        for(int k = 0; k < 8; ++k)
+          bytes[k] = word >> (8 * k);
+      }
+
+  number = recognize_accum_rect(accum, &plane, reach[0], reach[1],
+                                reach[2], reach[3], NULL);
+  g_free(pixels);
+  g_free(cleaned_buffer);
+  g_free(buffer);
+  return number;
+}
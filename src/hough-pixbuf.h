@@ -0,0 +1,37 @@
+#ifndef HOUGHPIXBUF_H
+#define HOUGHPIXBUF_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include "hough-recog.h"
+
+void
+hough_plane_from_pixbuf(const GdkPixbuf *image,
+                        hough_plane *plane);
+
+int*
+accum_matrix_from_image_with_length(const GdkPixbuf *image,
+                                    int *matrix_width,
+                                    int *matrix_height);
+
+int
+identify_number(GdkPixbuf *image,
+         GHashTable *lines);
+
+/* Paints the lines of a filter_accum_matrix() table of the image's
+ * accumulator over it in red, walking only the pixels on them */
+void
+highlight(GdkPixbuf *image, GHashTable *table);
+
+/* Digit of a scan the way the application recognizes it: adaptive
+ * binarization, specks and holes cleaned up, votes kept in accum
+ * between calls */
+int
+classify_pixbuf(const GdkPixbuf *image, hough_accum *accum);
+
+/* classify_pixbuf() of an image that has only changed within the
+ * rectangle x, y, width, height since accum last saw it */
+int
+classify_pixbuf_rect(const GdkPixbuf *image, hough_accum *accum,
+                     int x, int y, int width, int height);
+
+#endif // HOUGHPIXBUF_H
@@ -0,0 +1,1370 @@
+#include "hough-plane.h"
+#include <math.h>
+#include <string.h>
+#include "hough-bands.h"
+
+static int
+row_is_empty(const hough_plane *plane, int y)
+{
+  for(int j = 0; j < plane->width; ++j)
+    if(hough_plane_is_dark(plane, j, y))
+      return 0;
+  return 1;
+}
+
+/* Leftmost and rightmost dark columns of rows top to bottom: left and
+ * right only need to look past the current extremes */
+static void
+bbox_columns(const hough_plane *plane, int top, int bottom,
+             int *left, int *right)
+{
+  *left = plane->width - 1;
+  *right = 0;
+  for(int i = top; i <= bottom; ++i)
+    {
+      for(int j = 0; j < *left; ++j)
+        if(hough_plane_is_dark(plane, j, i))
+          {
+            *left = j;
+            break;
+          }
+      for(int j = plane->width - 1; j > *right; --j)
+        if(hough_plane_is_dark(plane, j, i))
+          {
+            *right = j;
+            break;
+          }
+    }
+}
+
+gboolean
+hough_plane_bbox(const hough_plane *plane,
+                 int *x, int *y,
+                 int *width,
+                 int *height)
+{
+  int top, bottom, left, right;
+
+  /* top */
+  for(top = 0; top < plane->height; ++top)
+    if(!row_is_empty(plane, top))
+      break;
+  if(top == plane->height)
+    return FALSE;
+
+  /* bottom */
+  for(bottom = plane->height - 1; bottom > top; --bottom)
+    if(!row_is_empty(plane, bottom))
+      break;
+
+  bbox_columns(plane, top, bottom, &left, &right);
+  *x = left;
+  *y = top;
+  *width = right - left + 1;
+  *height = bottom - top + 1;
+  return TRUE;
+}
+
+void
+hough_plane_sub(const hough_plane *plane,
+                int x, int y,
+                int width, int height,
+                hough_plane *sub)
+{
+  *sub = *plane;
+  sub->pixels = plane->pixels + (gsize)y * plane->rowstride;
+  if(plane->bits == 1)
+    sub->offset = plane->offset + x;
+  else
+    sub->pixels += x * plane->n_channels;
+  sub->width = width;
+  sub->height = height;
+}
+
+gboolean
+hough_plane_crop(const hough_plane *plane,
+                 hough_plane *cropped)
+{
+  int x, y, width, height;
+
+  if(!hough_plane_bbox(plane, &x, &y, &width, &height))
+    return FALSE;
+  hough_plane_sub(plane, x, y, width, height, cropped);
+  return TRUE;
+}
+
+gboolean
+hough_plane_bbox_near(const hough_plane *plane,
+                      int *x, int *y,
+                      int *width, int *height,
+                      int margin)
+{
+  hough_plane window;
+  int left, top, right, bottom;
+  int bx, by, bwidth, bheight;
+
+  left = MAX(*x - margin, 0);
+  top = MAX(*y - margin, 0);
+  right = MIN(*x + *width + margin, plane->width);
+  bottom = MIN(*y + *height + margin, plane->height);
+  if(left >= right || top >= bottom)
+    return FALSE;
+
+  hough_plane_sub(plane, left, top, right - left, bottom - top, &window);
+  if(!hough_plane_bbox(&window, &bx, &by, &bwidth, &bheight))
+    return FALSE;
+
+  /* touching a window edge inside the image means the digit may go on
+   * past it */
+  if((bx == 0 && left > 0) ||
+     (by == 0 && top > 0) ||
+     (bx + bwidth == window.width && right < plane->width) ||
+     (by + bheight == window.height && bottom < plane->height))
+    return FALSE;
+
+  *x = left + bx;
+  *y = top + by;
+  *width = bwidth;
+  *height = bheight;
+  return TRUE;
+}
+
+GArray*
+hough_plane_points(const hough_plane *plane)
+{
+  return hough_plane_points_scaled(plane, 1);
+}
+
+GArray*
+hough_plane_points_scaled(const hough_plane *plane,
+                          int factor)
+{
+  GArray *points;
+  hough_point *row_points;
+
+  points = g_array_new(FALSE, FALSE, sizeof (hough_point));
+  row_points = g_new(hough_point, (gsize)plane->width * factor);
+  for(int i = 0; i < plane->height; ++i)
+    {
+      const guchar *row = plane->pixels + (gsize)i * plane->rowstride;
+      int n = 0;
+
+      for(int j = 0; j < plane->width; ++j)
+        {
+          int bit = j + plane->offset;
+
+          /* light bytes of 1-bit rows are skipped whole */
+          if(plane->bits == 1 && (bit & 7) == 0 && j + 8 <= plane->width &&
+             row[bit >> 3] == 0)
+            {
+              j += 7;
+              continue;
+            }
+          if(hough_plane_is_dark(plane, j, i))
+            for(int x = j * factor; x < (j + 1) * factor; ++x)
+              row_points[n++].x = x;
+        }
+      for(int y = i * factor; y < (i + 1) * factor && n > 0; ++y)
+        {
+          for(int k = 0; k < n; ++k)
+            row_points[k].y = y;
+          g_array_append_vals(points, row_points, n);
+        }
+    }
+  g_free(row_points);
+  return points;
+}
+
+guint64
+hough_plane_word(const hough_plane *plane,
+                 int x, int y,
+                 int n)
+{
+  const guchar *row;
+  guint64 word;
+
+  row = plane->pixels + (gsize)y * plane->rowstride;
+  word = 0;
+  if(plane->bits == 1)
+    {
+      int bit = x + plane->offset;
+      int shift = bit & 7;
+      int n_bytes = (shift + n + 7) >> 3;
+      const guchar *bytes = row + (bit >> 3);
+
+      for(int k = 0; k < MIN(n_bytes, 8); ++k)
+        word |= (guint64)bytes[k] << (8 * k);
+      word >>= shift;
+      /* the ninth byte only comes in with a shift */
+      if(n_bytes > 8)
+        word |= (guint64)bytes[8] << (64 - shift);
+    }
+  else
+    for(int j = 0; j < n; ++j)
+      if(row[(x + j) * plane->n_channels] < PLANE_DARK_LEVEL)
+        word |= (guint64)1 << j;
+  return n < 64 ? word & (((guint64)1 << n) - 1) : word;
+}
+
+static double
+plane_value(const hough_plane *plane, const guchar *row, int x)
+{
+  if(plane->bits == 1)
+    {
+      x += plane->offset;
+      return (row[x >> 3] >> (x & 7)) & 1 ? 0 : 255;
+    }
+  return row[x * plane->n_channels];
+}
+
+/* Area average for downscaling: every output pixel is the mean of the
+ * source rectangle it covers. A source pixel straddling an output border
+ * is split between both neighbours by coverage, so the weights of every
+ * row and column are computed once and each source pixel is read once. */
+
+static void
+area_weights(int src, int dst, int *index, float *weight)
+{
+  double ratio = (double)src / dst;
+
+  for(int n = 0; n < src; ++n)
+    {
+      int cell = MIN(n / ratio, dst - 1);
+      double border = (cell + 1) * ratio;
+
+      index[n] = cell;
+      weight[n] = n + 1 <= border || cell == dst - 1 ? 1 : border - n;
+    }
+}
+
+guchar*
+hough_plane_resample(const hough_plane *plane,
+                     int width, int height,
+                     hough_plane *resampled)
+{
+  guchar *buffer;
+  float *row_sums, *sums;
+  float *x_weight, *y_weight;
+  int *x_index, *y_index;
+  double norm;
+
+  buffer = g_malloc((gsize)width * height);
+  x_index = g_new(int, plane->width);
+  x_weight = g_new(float, plane->width);
+  y_index = g_new(int, plane->height);
+  y_weight = g_new(float, plane->height);
+  row_sums = g_new(float, width + 1);
+  sums = g_new0(float, (gsize)(height + 1) * width);
+
+  area_weights(plane->width, width, x_index, x_weight);
+  area_weights(plane->height, height, y_index, y_weight);
+
+  for(int i = 0; i < plane->height; ++i)
+    {
+      const guchar *row = plane->pixels + (gsize)i * plane->rowstride;
+      float *upper = sums + (gsize)y_index[i] * width;
+      float *lower = upper + width;
+
+      for(int x = 0; x <= width; ++x)
+        row_sums[x] = 0;
+      for(int j = 0; j < plane->width; ++j)
+        {
+          float value = plane_value(plane, row, j);
+          row_sums[x_index[j]] += value * x_weight[j];
+          row_sums[x_index[j] + 1] += value * (1 - x_weight[j]);
+        }
+      for(int x = 0; x < width; ++x)
+        {
+          upper[x] += row_sums[x] * y_weight[i];
+          lower[x] += row_sums[x] * (1 - y_weight[i]);
+        }
+    }
+
+  norm = (double)width * height / ((double)plane->width * plane->height);
+  for(gsize n = 0; n < (gsize)width * height; ++n)
+    buffer[n] = MIN(sums[n] * norm + 0.5, 255);
+
+  g_free(x_index);
+  g_free(x_weight);
+  g_free(y_index);
+  g_free(y_weight);
+  g_free(row_sums);
+  g_free(sums);
+
+  resampled->pixels = buffer;
+  resampled->width = width;
+  resampled->height = height;
+  resampled->rowstride = width;
+  resampled->n_channels = 1;
+  resampled->bits = 8;
+  resampled->offset = 0;
+  return buffer;
+}
+
+/* Same fixed point weights as CV_BGR2GRAY, so that thresholding the
+ * result matches toBinary() */
+static inline guchar
+pixel_gray(const hough_plane *plane, const guchar *row, int x)
+{
+  const guchar *p;
+
+  if(plane->bits == 1 || plane->n_channels < 3)
+    return plane_value(plane, row, x);
+  p = row + x * plane->n_channels;
+  return (p[0] * 4899 + p[1] * 9617 + p[2] * 1868 + (1 << 13)) >> 14;
+}
+
+/* One row of luminance, written for the compiler to vectorize: one
+ * loop per pixel layout with the channel count known */
+static void
+gray_row(const hough_plane *plane, int y, guchar *out)
+{
+  const guchar *row = plane->pixels + (gsize)y * plane->rowstride;
+  int width = plane->width;
+
+  if(plane->bits == 1)
+    for(int j = 0; j < width; ++j)
+      out[j] = plane_value(plane, row, j);
+  else if(plane->n_channels == 1)
+    memcpy(out, row, width);
+  else if(plane->n_channels == 3)
+    for(int j = 0; j < width; ++j)
+      out[j] = (row[3 * j] * 4899 + row[3 * j + 1] * 9617 +
+                row[3 * j + 2] * 1868 + (1 << 13)) >> 14;
+  else if(plane->n_channels == 4)
+    for(int j = 0; j < width; ++j)
+      out[j] = (row[4 * j] * 4899 + row[4 * j + 1] * 9617 +
+                row[4 * j + 2] * 1868 + (1 << 13)) >> 14;
+  else
+    for(int j = 0; j < width; ++j)
+      out[j] = pixel_gray(plane, row, j);
+}
+
+void
+hough_plane_gray_into(const hough_plane *plane,
+                      guchar *pixels,
+                      hough_plane *gray)
+{
+  for(int i = 0; i < plane->height; ++i)
+    gray_row(plane, i, pixels + (gsize)i * plane->width);
+
+  gray->pixels = pixels;
+  gray->width = plane->width;
+  gray->height = plane->height;
+  gray->rowstride = plane->width;
+  gray->n_channels = 1;
+  gray->bits = 8;
+  gray->offset = 0;
+}
+
+guchar*
+hough_plane_gray(const hough_plane *plane,
+                 hough_plane *gray)
+{
+  guchar *buffer;
+
+  buffer = g_malloc((gsize)plane->width * plane->height);
+  hough_plane_gray_into(plane, buffer, gray);
+  return buffer;
+}
+
+/* Packs a row of 0/1 bytes, eight at a time: the multiplication moves
+ * byte k of the little endian word to bit 56 + k without carries */
+static void
+pack_mask(const guchar *mask, int width, guchar *out)
+{
+  int j;
+
+  for(j = 0; j + 8 <= width; j += 8)
+    {
+      guint64 word;
+
+      memcpy(&word, mask + j, 8);
+      out[j >> 3] = (GUINT64_FROM_LE(word) * 0x0102040810204080ULL) >> 56;
+    }
+  for(; j < width; ++j)
+    out[j >> 3] |= mask[j] << (j & 7);
+}
+
+static guchar*
+new_binary(const hough_plane *plane, hough_plane *binary)
+{
+  guchar *buffer;
+  int stride;
+
+  /* rows padded to whole 64-bit words like raw containers */
+  stride = (plane->width + 63) / 64 * 8;
+  buffer = g_malloc0((gsize)stride * plane->height);
+
+  binary->pixels = buffer;
+  binary->width = plane->width;
+  binary->height = plane->height;
+  binary->rowstride = stride;
+  binary->n_channels = 1;
+  binary->bits = 1;
+  binary->offset = 0;
+  return buffer;
+}
+
+static void
+binarize_rows(const hough_plane *plane, int level, int first, int last,
+              guchar *buffer, int stride)
+{
+  guchar *gray, *mask;
+  int width;
+
+  width = plane->width;
+  gray = g_malloc(width);
+  mask = g_malloc(width);
+  for(int i = first; i < last; ++i)
+    {
+      gray_row(plane, i, gray);
+      for(int j = 0; j < width; ++j)
+        mask[j] = gray[j] < level;
+      pack_mask(mask, width, buffer + (gsize)i * stride);
+    }
+  g_free(gray);
+  g_free(mask);
+}
+
+guchar*
+hough_plane_binarize(const hough_plane *plane,
+                     hough_plane *binary)
+{
+  return hough_plane_binarize_level(plane, PLANE_DARK_LEVEL, binary);
+}
+
+guchar*
+hough_plane_binarize_level(const hough_plane *plane,
+                           int level,
+                           hough_plane *binary)
+{
+  guchar *buffer;
+
+  buffer = new_binary(plane, binary);
+  binarize_rows(plane, level, 0, plane->height, buffer, binary->rowstride);
+  return buffer;
+}
+
+/* Adds the luminance of rows first to last - 1 to histogram */
+static void
+add_histogram(const hough_plane *plane, int first, int last,
+              guint *histogram)
+{
+  guint hist[4][256];
+  guchar *gray;
+  int j;
+
+  /* four histograms, so that runs of equal pixels do not wait on the
+   * same counter */
+  memset(hist, 0, sizeof(hist));
+  gray = g_malloc(plane->width);
+  for(int i = first; i < last; ++i)
+    {
+      gray_row(plane, i, gray);
+      for(j = 0; j + 4 <= plane->width; j += 4)
+        {
+          hist[0][gray[j]]++;
+          hist[1][gray[j + 1]]++;
+          hist[2][gray[j + 2]]++;
+          hist[3][gray[j + 3]]++;
+        }
+      for(; j < plane->width; ++j)
+        hist[0][gray[j]]++;
+    }
+  g_free(gray);
+  for(int v = 0; v < 256; ++v)
+    histogram[v] += hist[0][v] + hist[1][v] + hist[2][v] + hist[3][v];
+}
+
+static int
+otsu_level(const guint *hist)
+{
+  double total, sum, sum_dark, n_dark;
+  double best_variance;
+  int best;
+
+  total = 0;
+  sum = 0;
+  for(int v = 0; v < 256; ++v)
+    {
+      total += hist[v];
+      sum += (double)v * hist[v];
+    }
+
+  /* the split with the largest variance between the two classes */
+  best = PLANE_DARK_LEVEL - 1;
+  best_variance = -1;
+  sum_dark = 0;
+  n_dark = 0;
+  for(int v = 0; v < 255; ++v)
+    {
+      double n_light, mean_dark, mean_light, variance;
+
+      n_dark += hist[v];
+      sum_dark += (double)v * hist[v];
+      n_light = total - n_dark;
+      if(n_dark == 0)
+        continue;
+      if(n_light == 0)
+        break;
+      mean_dark = sum_dark / n_dark;
+      mean_light = (sum - sum_dark) / n_light;
+      variance = n_dark * n_light * (mean_dark - mean_light) *
+          (mean_dark - mean_light);
+      if(variance > best_variance)
+        {
+          best_variance = variance;
+          best = v;
+        }
+    }
+  return best + 1;
+}
+
+int
+hough_plane_otsu(const hough_plane *plane)
+{
+  guint hist[256];
+
+  memset(hist, 0, sizeof(hist));
+  add_histogram(plane, 0, plane->height, hist);
+  return otsu_level(hist);
+}
+
+/* Bradley's local threshold: a pixel is dark if it is ADAPTIVE_PERCENT
+ * darker than the mean of the window around it. Window sums come from
+ * an integral image of 32-bit sums; they wrap on large images, but the
+ * differences of four corners stay exact while a window holds less than
+ * 2^32 / 255 pixels. */
+static void
+adaptive_row(const guchar *gray, const guint32 *integral,
+             int width, int height, int half, const int *count_x, int i,
+             guint32 *padded, guchar *mask, guchar *out)
+{
+  const guchar *g = gray + (gsize)i * width;
+  int top = MAX(i - half, 0);
+  int bottom = MIN(i + half + 1, height);
+  const guint32 *upper = integral + (gsize)top * (width + 1);
+  const guint32 *lower = integral + (gsize)bottom * (width + 1);
+  guint32 *columns = padded + half;
+
+  /* column sums of the window rows, edges repeated so that every pixel
+   * subtracts the same way */
+  for(int x = 0; x <= width; ++x)
+    columns[x] = lower[x] - upper[x];
+  for(int k = 1; k <= half; ++k)
+    {
+      columns[-k] = columns[0];
+      columns[width + k] = columns[width];
+    }
+
+  for(int j = 0; j < width; ++j)
+    {
+      guint32 box = padded[j + 2 * half + 1] - padded[j];
+      guint64 count = (guint64)count_x[j] * (bottom - top);
+
+      mask[j] = (guint64)g[j] * count * 100 <=
+          (guint64)box * (100 - ADAPTIVE_PERCENT);
+    }
+  pack_mask(mask, width, out);
+}
+
+guchar*
+hough_plane_binarize_adaptive(const hough_plane *plane,
+                              int window,
+                              hough_plane *binary)
+{
+  guchar *buffer, *gray, *mask;
+  guint32 *integral, *padded;
+  int *count_x;
+  int width, height, half;
+
+  width = plane->width;
+  height = plane->height;
+  if(window <= 0)
+    window = MAX(width, height) / ADAPTIVE_WINDOW_RATIO;
+  half = MAX(window / 2, 1);
+
+  buffer = new_binary(plane, binary);
+  gray = g_malloc((gsize)width * height);
+  mask = g_malloc(width);
+  integral = g_new0(guint32, (gsize)(width + 1) * (height + 1));
+  padded = g_new(guint32, width + 2 * half + 1);
+  count_x = g_new(int, width);
+
+  for(int i = 0; i < height; ++i)
+    {
+      guchar *g = gray + (gsize)i * width;
+      guint32 *above = integral + (gsize)i * (width + 1);
+      guint32 *current = above + width + 1;
+      guint32 row_sum = 0;
+
+      gray_row(plane, i, g);
+      for(int j = 0; j < width; ++j)
+        {
+          row_sum += g[j];
+          current[j + 1] = above[j + 1] + row_sum;
+        }
+    }
+  for(int j = 0; j < width; ++j)
+    count_x[j] = MIN(j + half + 1, width) - MAX(j - half, 0);
+
+  for(int i = 0; i < height; ++i)
+    adaptive_row(gray, integral, width, height, half, count_x, i,
+                 padded, mask, buffer + (gsize)i * binary->rowstride);
+
+  g_free(gray);
+  g_free(mask);
+  g_free(integral);
+  g_free(padded);
+  g_free(count_x);
+  return buffer;
+}
+
+guchar*
+hough_plane_threshold(const hough_plane *plane,
+                      hough_threshold mode,
+                      hough_plane *binary)
+{
+  switch(mode)
+    {
+    case PLANE_THRESHOLD_OTSU:
+      return hough_plane_binarize_level(plane, hough_plane_otsu(plane),
+                                        binary);
+    case PLANE_THRESHOLD_ADAPTIVE:
+      return hough_plane_binarize_adaptive(plane, 0, binary);
+    default:
+      return hough_plane_binarize(plane, binary);
+    }
+}
+
+/* Row band versions of the binarization and the bounding box on the
+ * pool of hough-bands.c. Every band writes rows of its own and what the
+ * bands count or find is put together afterwards, so the results are
+ * those of the serial functions above. */
+
+/* pixels a band should at least have to be worth a thread */
+#define BAND_PIXELS (1 << 18)
+
+typedef struct plane_bands
+{
+  const hough_plane *plane;
+  int level;
+  guchar *buffer;
+  int stride;
+  /* adaptive threshold */
+  guchar *gray;
+  guint32 *integral;
+  int *count_x;
+  int half;
+  /* 256 counts per band */
+  guint *hist;
+  /* top, bottom, left and right per band, top -1 if it is empty */
+  int *box;
+} plane_bands;
+
+static int
+plane_band_count(const hough_plane *plane)
+{
+  return hough_bands_count(plane->height,
+                           BAND_PIXELS / MAX(plane->width, 1) + 1);
+}
+
+static void
+binarize_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+
+  binarize_rows(job->plane, job->level, first, last, job->buffer,
+                job->stride);
+}
+
+static void
+histogram_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+
+  add_histogram(job->plane, first, last, job->hist + band * 256);
+}
+
+/* Gray rows and their running sums, not yet added to the rows above */
+static void
+row_sums_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+  int width = job->plane->width;
+
+  for(int i = first; i < last; ++i)
+    {
+      guchar *g = job->gray + (gsize)i * width;
+      guint32 *current = job->integral + (gsize)(i + 1) * (width + 1);
+
+      gray_row(job->plane, i, g);
+      current[0] = 0;
+      for(int j = 0; j < width; ++j)
+        current[j + 1] = current[j] + g[j];
+    }
+}
+
+/* Bands of columns this time, adding every row to the one below */
+static void
+column_sums_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+  int width = job->plane->width;
+
+  for(int i = 1; i <= job->plane->height; ++i)
+    {
+      const guint32 *above = job->integral + (gsize)(i - 1) * (width + 1);
+      guint32 *current = job->integral + (gsize)i * (width + 1);
+
+      for(int x = first; x < last; ++x)
+        current[x] += above[x];
+    }
+}
+
+static void
+adaptive_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+  int width = job->plane->width;
+  guint32 *padded;
+  guchar *mask;
+
+  padded = g_new(guint32, width + 2 * job->half + 1);
+  mask = g_malloc(width);
+  for(int i = first; i < last; ++i)
+    adaptive_row(job->gray, job->integral, width, job->plane->height,
+                 job->half, job->count_x, i, padded, mask,
+                 job->buffer + (gsize)i * job->stride);
+  g_free(padded);
+  g_free(mask);
+}
+
+static void
+bbox_band(int band, int first, int last, gpointer data)
+{
+  plane_bands *job = data;
+  int *box = job->box + 4 * band;
+  int top, bottom;
+
+  for(top = first; top < last; ++top)
+    if(!row_is_empty(job->plane, top))
+      break;
+  if(top == last)
+    {
+      box[0] = -1;
+      return;
+    }
+  for(bottom = last - 1; bottom > top; --bottom)
+    if(!row_is_empty(job->plane, bottom))
+      break;
+  box[0] = top;
+  box[1] = bottom;
+  bbox_columns(job->plane, top, bottom, &box[2], &box[3]);
+}
+
+static int
+otsu_parallel(plane_bands *job, int n_bands)
+{
+  int level;
+
+  job->hist = g_new0(guint, 256 * n_bands);
+  hough_bands_run(job->plane->height, n_bands, histogram_band, job);
+  for(int band = 1; band < n_bands; ++band)
+    for(int v = 0; v < 256; ++v)
+      job->hist[v] += job->hist[band * 256 + v];
+  level = otsu_level(job->hist);
+  g_free(job->hist);
+  return level;
+}
+
+/* hough_plane_binarize_adaptive() with the default window; the sums
+ * wrap the same way whatever order they are added in */
+static void
+adaptive_parallel(plane_bands *job, int n_bands)
+{
+  int width, height;
+
+  width = job->plane->width;
+  height = job->plane->height;
+  job->half = MAX(MAX(width, height) / ADAPTIVE_WINDOW_RATIO / 2, 1);
+  job->gray = g_malloc((gsize)width * height);
+  job->integral = g_new(guint32, (gsize)(width + 1) * (height + 1));
+  job->count_x = g_new(int, width);
+  memset(job->integral, 0, (width + 1) * sizeof (guint32));
+  for(int j = 0; j < width; ++j)
+    job->count_x[j] = MIN(j + job->half + 1, width) - MAX(j - job->half, 0);
+
+  hough_bands_run(height, n_bands, row_sums_band, job);
+  hough_bands_run(width + 1,
+                  hough_bands_count(width + 1,
+                                    BAND_PIXELS / MAX(height, 1) + 1),
+                  column_sums_band, job);
+  hough_bands_run(height, n_bands, adaptive_band, job);
+
+  g_free(job->gray);
+  g_free(job->integral);
+  g_free(job->count_x);
+}
+
+guchar*
+hough_plane_threshold_parallel(const hough_plane *plane,
+                               hough_threshold mode,
+                               hough_plane *binary)
+{
+  plane_bands job;
+  int n_bands;
+
+  memset(&job, 0, sizeof(job));
+  job.plane = plane;
+  job.level = PLANE_DARK_LEVEL;
+  n_bands = plane_band_count(plane);
+  if(mode == PLANE_THRESHOLD_OTSU)
+    job.level = otsu_parallel(&job, n_bands);
+
+  job.buffer = new_binary(plane, binary);
+  job.stride = binary->rowstride;
+  if(mode == PLANE_THRESHOLD_ADAPTIVE)
+    adaptive_parallel(&job, n_bands);
+  else
+    hough_bands_run(plane->height, n_bands, binarize_band, &job);
+  return job.buffer;
+}
+
+gboolean
+hough_plane_bbox_parallel(const hough_plane *plane,
+                          int *x, int *y,
+                          int *width,
+                          int *height)
+{
+  plane_bands job;
+  int n_bands, top, bottom, left, right;
+
+  memset(&job, 0, sizeof(job));
+  job.plane = plane;
+  n_bands = plane_band_count(plane);
+  job.box = g_new(int, 4 * n_bands);
+  hough_bands_run(plane->height, n_bands, bbox_band, &job);
+
+  top = -1;
+  bottom = left = right = 0;
+  for(int band = 0; band < n_bands; ++band)
+    {
+      const int *box = job.box + 4 * band;
+
+      if(box[0] < 0)
+        continue;
+      if(top < 0)
+        {
+          top = box[0];
+          left = box[2];
+          right = box[3];
+        }
+      left = MIN(left, box[2]);
+      right = MAX(right, box[3]);
+      bottom = box[1];
+    }
+  g_free(job.box);
+  if(top < 0)
+    return FALSE;
+
+  *x = left;
+  *y = top;
+  *width = right - left + 1;
+  *height = bottom - top + 1;
+  return TRUE;
+}
+
+/* Morphology on rows of 64 pixel words: one shift and one AND or OR
+ * move a whole word of pixels by one step of the square. Erosion takes
+ * pixels outside the image as dark and dilation as light, so neither
+ * eats into a digit touching the border. */
+
+static inline guint64
+word_at(const guint64 *row, int k, int n_words,
+        guint64 last_mask, guint64 outside)
+{
+  if(k == n_words - 1)
+    return (row[k] & last_mask) | (outside & ~last_mask);
+  return row[k];
+}
+
+static void
+morph_words(const guint64 *src, guint64 *dst,
+            int n_words, int height, guint64 last_mask,
+            int radius, gboolean erode)
+{
+  guint64 outside, *along;
+
+  outside = erode ? ~G_GUINT64_CONSTANT(0) : 0;
+  along = g_new(guint64, (gsize)n_words * height);
+
+  for(int i = 0; i < height; ++i)
+    {
+      const guint64 *row = src + (gsize)i * n_words;
+      guint64 *out = along + (gsize)i * n_words;
+
+      for(int k = 0; k < n_words; ++k)
+        {
+          guint64 word, prev, next, acc;
+
+          word = word_at(row, k, n_words, last_mask, outside);
+          prev = k > 0 ? row[k - 1] : outside;
+          next = k + 1 < n_words ?
+              word_at(row, k + 1, n_words, last_mask, outside) : outside;
+          acc = word;
+          for(int s = 1; s <= radius; ++s)
+            {
+              guint64 left = (word << s) | (prev >> (64 - s));
+              guint64 right = (word >> s) | (next << (64 - s));
+
+              acc = erode ? acc & left & right : acc | left | right;
+            }
+          out[k] = acc;
+        }
+    }
+
+  for(int i = 0; i < height; ++i)
+    for(int k = 0; k < n_words; ++k)
+      {
+        guint64 acc = along[(gsize)i * n_words + k];
+
+        for(int d = 1; d <= radius; ++d)
+          {
+            guint64 above = i - d >= 0 ?
+                along[(gsize)(i - d) * n_words + k] : outside;
+            guint64 below = i + d < height ?
+                along[(gsize)(i + d) * n_words + k] : outside;
+
+            acc = erode ? acc & above & below : acc | above | below;
+          }
+        if(k == n_words - 1)
+          acc &= last_mask;
+        dst[(gsize)i * n_words + k] = acc;
+      }
+
+  g_free(along);
+}
+
+guchar*
+hough_plane_clean(const hough_plane *plane,
+                  int open_radius,
+                  int close_radius,
+                  hough_plane *cleaned)
+{
+  guchar *buffer;
+  guint64 *words, *spare, last_mask;
+  int n_words;
+  gsize n;
+
+  /* the packed layout of hough_plane_binarize() is rows of words */
+  buffer = hough_plane_binarize(plane, cleaned);
+  words = (guint64*)buffer;
+  n_words = cleaned->rowstride / 8;
+  n = (gsize)n_words * plane->height;
+  last_mask = plane->width % 64 ?
+      (G_GUINT64_CONSTANT(1) << (plane->width % 64)) - 1 :
+      ~G_GUINT64_CONSTANT(0);
+  open_radius = CLAMP(open_radius, 0, MORPH_MAX_RADIUS);
+  close_radius = CLAMP(close_radius, 0, MORPH_MAX_RADIUS);
+
+  for(gsize k = 0; k < n; ++k)
+    words[k] = GUINT64_FROM_LE(words[k]);
+  spare = g_new(guint64, n);
+  if(open_radius > 0)
+    {
+      morph_words(words, spare, n_words, plane->height, last_mask,
+                  open_radius, TRUE);
+      morph_words(spare, words, n_words, plane->height, last_mask,
+                  open_radius, FALSE);
+    }
+  if(close_radius > 0)
+    {
+      morph_words(words, spare, n_words, plane->height, last_mask,
+                  close_radius, FALSE);
+      morph_words(spare, words, n_words, plane->height, last_mask,
+                  close_radius, TRUE);
+    }
+  g_free(spare);
+  for(gsize k = 0; k < n; ++k)
+    words[k] = GUINT64_TO_LE(words[k]);
+
+  return buffer;
+}
+
+/* Zhang-Suen thinning. The eight neighbours of a pixel, clockwise from
+ * the one above, make a byte; a table per subiteration tells whether a
+ * pixel with that neighbourhood is a removable contour point. Only the
+ * pixels still dark are visited again. */
+
+static void
+thin_tables(guchar *remove_first, guchar *remove_second)
+{
+  for(int code = 0; code < 256; ++code)
+    {
+      int p[8], count, transitions;
+
+      count = 0;
+      for(int k = 0; k < 8; ++k)
+        {
+          p[k] = (code >> k) & 1;
+          count += p[k];
+        }
+      transitions = 0;
+      for(int k = 0; k < 8; ++k)
+        transitions += !p[k] && p[(k + 1) % 8];
+
+      /* p[0] north, p[2] east, p[4] south, p[6] west */
+      remove_first[code] = count >= 2 && count <= 6 && transitions == 1 &&
+          !(p[0] && p[2] && p[4]) && !(p[2] && p[4] && p[6]);
+      remove_second[code] = count >= 2 && count <= 6 && transitions == 1 &&
+          !(p[0] && p[2] && p[6]) && !(p[0] && p[4] && p[6]);
+    }
+}
+
+guchar*
+hough_plane_thin(const hough_plane *plane,
+                 hough_plane *thinned,
+                 int *dark_before,
+                 int *dark_after)
+{
+  guchar remove[2][256];
+  guchar *mask, *buffer, *row;
+  GArray *dark, *doomed;
+  int width, height, stride;
+  int offsets[8];
+  gboolean changed;
+
+  thin_tables(remove[0], remove[1]);
+  width = plane->width;
+  height = plane->height;
+  /* a light border keeps neighbour reads inside */
+  stride = width + 2;
+  mask = g_malloc0((gsize)stride * (height + 2));
+  dark = g_array_new(FALSE, FALSE, sizeof(int));
+  doomed = g_array_new(FALSE, FALSE, sizeof(int));
+  for(int i = 0; i < height; ++i)
+    for(int j = 0; j < width; ++j)
+      if(hough_plane_is_dark(plane, j, i))
+        {
+          int index = (i + 1) * stride + j + 1;
+          mask[index] = 1;
+          g_array_append_val(dark, index);
+        }
+  if(dark_before != NULL)
+    *dark_before = dark->len;
+
+  offsets[0] = -stride;
+  offsets[1] = -stride + 1;
+  offsets[2] = 1;
+  offsets[3] = stride + 1;
+  offsets[4] = stride;
+  offsets[5] = stride - 1;
+  offsets[6] = -1;
+  offsets[7] = -stride - 1;
+
+  do
+    {
+      changed = FALSE;
+      for(int pass = 0; pass < 2; ++pass)
+        {
+          guint kept = 0;
+
+          g_array_set_size(doomed, 0);
+          for(guint n = 0; n < dark->len; ++n)
+            {
+              int index = g_array_index(dark, int, n);
+              int code = 0;
+
+              for(int k = 0; k < 8; ++k)
+                code |= mask[index + offsets[k]] << k;
+              if(remove[pass][code])
+                g_array_append_val(doomed, index);
+              else
+                g_array_index(dark, int, kept++) = index;
+            }
+          /* removals of a subiteration are simultaneous */
+          for(guint n = 0; n < doomed->len; ++n)
+            mask[g_array_index(doomed, int, n)] = 0;
+          g_array_set_size(dark, kept);
+          changed = changed || doomed->len > 0;
+        }
+    }
+  while(changed);
+  if(dark_after != NULL)
+    *dark_after = dark->len;
+
+  buffer = new_binary(plane, thinned);
+  for(int i = 0; i < height; ++i)
+    {
+      row = mask + (gsize)(i + 1) * stride + 1;
+      pack_mask(row, width, buffer + (gsize)i * thinned->rowstride);
+    }
+
+  g_array_free(dark, TRUE);
+  g_array_free(doomed, TRUE);
+  g_free(mask);
+  return buffer;
+}
+
+GArray*
+hough_plane_edges(const hough_plane *plane)
+{
+  GArray *edges;
+  guchar *mask;
+  int stride;
+
+  /* dark mask with a light border, so the 3x3 windows need no checks */
+  stride = plane->width + 2;
+  mask = g_malloc0((gsize)stride * (plane->height + 2));
+  for(int i = 0; i < plane->height; ++i)
+    for(int j = 0; j < plane->width; ++j)
+      mask[(i + 1) * stride + j + 1] = hough_plane_is_dark(plane, j, i);
+
+  edges = g_array_new(FALSE, FALSE, sizeof (hough_edge));
+  for(int i = 0; i < plane->height; ++i)
+    for(int j = 0; j < plane->width; ++j)
+      {
+        const guchar *m = mask + (i + 1) * stride + j + 1;
+        hough_edge edge;
+
+        if(!m[0] ||
+           (m[-stride - 1] & m[-stride] & m[-stride + 1] & m[-1] & m[1] &
+            m[stride - 1] & m[stride] & m[stride + 1]))
+          continue;
+        edge.x = j;
+        edge.y = i;
+        edge.gx = (m[-stride + 1] + 2 * m[1] + m[stride + 1]) -
+            (m[-stride - 1] + 2 * m[-1] + m[stride - 1]);
+        edge.gy = (m[stride - 1] + 2 * m[stride] + m[stride + 1]) -
+            (m[-stride - 1] + 2 * m[-stride] + m[-stride + 1]);
+        g_array_append_val(edges, edge);
+      }
+  g_free(mask);
+  return edges;
+}
+
+/* Shift of a whole row or column in a shear. Every row moves by an
+ * integer, so the shear maps pixels one to one. */
+static inline int
+shear_shift(double factor, int v)
+{
+  return (int)floor(factor * v + 0.5);
+}
+
+/* Range [*lo, *hi] sheared by factor along [from_lo, from_hi] */
+static void
+shear_range(double factor, int from_lo, int from_hi, int *lo, int *hi)
+{
+  int a = shear_shift(factor, from_lo), b = shear_shift(factor, from_hi);
+
+  *lo += MIN(a, b);
+  *hi += MAX(a, b);
+}
+
+/* Shifts of a shear by factor for v from lo to hi */
+static int*
+shear_table(double factor, int lo, int hi)
+{
+  int *table = g_new(int, hi - lo + 1);
+
+  for(int v = lo; v <= hi; ++v)
+    table[v - lo] = shear_shift(factor, v);
+  return table;
+}
+
+void
+hough_points_rotate(GArray *points,
+                    double degrees,
+                    int *width,
+                    int *height)
+{
+  double along, across;
+  int *x_shift, *y_shift, *x_shift2;
+  int cx, cy, x1_lo, x1_hi, y_lo, y_hi;
+  int left, top, right, bottom;
+
+  if(points->len == 0)
+    return;
+  /* three shears, x by -tan(phi / 2), y by sin(phi), x again, turn the
+   * points without holes or doubles */
+  along = -tan(degrees * M_PI / 360);
+  across = sin(degrees * M_PI / 180);
+  cx = *width / 2;
+  cy = *height / 2;
+
+  /* where the corners can go bounds the tables */
+  x1_lo = -cx;
+  x1_hi = *width - 1 - cx;
+  shear_range(along, -cy, *height - 1 - cy, &x1_lo, &x1_hi);
+  y_lo = -cy;
+  y_hi = *height - 1 - cy;
+  shear_range(across, x1_lo, x1_hi, &y_lo, &y_hi);
+  x_shift = shear_table(along, -cy, *height - 1 - cy);
+  y_shift = shear_table(across, x1_lo, x1_hi);
+  x_shift2 = shear_table(along, y_lo, y_hi);
+
+  left = top = G_MAXINT;
+  right = bottom = G_MININT;
+  for(guint k = 0; k < points->len; ++k)
+    {
+      hough_point *point = &g_array_index(points, hough_point, k);
+      int x = point->x - cx + x_shift[point->y];
+      int y = point->y - cy + y_shift[x - x1_lo];
+
+      x += x_shift2[y - y_lo];
+      point->x = x;
+      point->y = y;
+      left = MIN(left, x);
+      right = MAX(right, x);
+      top = MIN(top, y);
+      bottom = MAX(bottom, y);
+    }
+  g_free(x_shift);
+  g_free(y_shift);
+  g_free(x_shift2);
+
+  for(guint k = 0; k < points->len; ++k)
+    {
+      g_array_index(points, hough_point, k).x -= left;
+      g_array_index(points, hough_point, k).y -= top;
+    }
+  *width = right - left + 1;
+  *height = bottom - top + 1;
+}
+
+/* Adds area to the dark coverage of pixel x, y of the plane of
+ * hough_plane_from_points(), dark once more than half covered */
+static inline void
+cover_pixel(float *coverage, guchar *buffer, hough_plane *bounds,
+            int x, int y, float area, float half, int *box)
+{
+  float *cell;
+
+  if(area <= 0 || x >= bounds->width || y >= bounds->height)
+    return;
+  cell = coverage + (gsize)y * bounds->width + x;
+  if(*cell <= half && *cell + area > half)
+    {
+      buffer[(gsize)y * bounds->rowstride + (x >> 3)] |= 1 << (x & 7);
+      box[0] = MIN(box[0], x);
+      box[1] = MIN(box[1], y);
+      box[2] = MAX(box[2], x);
+      box[3] = MAX(box[3], y);
+    }
+  *cell += area;
+}
+
+guchar*
+hough_plane_from_points(const GArray *points,
+                        int width,
+                        int height,
+                        int out_width,
+                        int out_height,
+                        hough_plane *plane)
+{
+  hough_plane bounds;
+  guchar *buffer;
+  float *coverage, *x_weight, *y_weight, half;
+  int *x_index, *y_index, box[4];
+
+  bounds.width = out_width;
+  bounds.height = out_height;
+  buffer = new_binary(&bounds, &bounds);
+  coverage = g_new0(float, (gsize)out_width * out_height);
+  x_index = g_new(int, width);
+  x_weight = g_new(float, width);
+  y_index = g_new(int, height);
+  y_weight = g_new(float, height);
+  /* the points are split between the pixels like the source pixels of
+   * hough_plane_resample() */
+  area_weights(width, out_width, x_index, x_weight);
+  area_weights(height, out_height, y_index, y_weight);
+  half = (double)width * height / ((double)out_width * out_height) / 2;
+
+  box[0] = out_width;
+  box[1] = out_height;
+  box[2] = -1;
+  box[3] = -1;
+  for(guint k = 0; k < points->len; ++k)
+    {
+      const hough_point *point = &g_array_index(points, hough_point, k);
+      int x = x_index[point->x], y = y_index[point->y];
+      float wx = x_weight[point->x], wy = y_weight[point->y];
+
+      cover_pixel(coverage, buffer, &bounds, x, y, wx * wy, half, box);
+      cover_pixel(coverage, buffer, &bounds, x + 1, y, (1 - wx) * wy,
+                  half, box);
+      cover_pixel(coverage, buffer, &bounds, x, y + 1, wx * (1 - wy),
+                  half, box);
+      cover_pixel(coverage, buffer, &bounds, x + 1, y + 1,
+                  (1 - wx) * (1 - wy), half, box);
+    }
+  g_free(coverage);
+  g_free(x_index);
+  g_free(x_weight);
+  g_free(y_index);
+  g_free(y_weight);
+
+  if(box[2] < 0)
+    box[0] = box[1] = box[2] = box[3] = 0;
+  hough_plane_sub(&bounds, box[0], box[1], box[2] - box[0] + 1,
+                  box[3] - box[1] + 1, plane);
+  return buffer;
+}
+
+#define HASH_PRIME1 0x9e3779b185ebca87ULL
+#define HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define HASH_PRIME3 0x165667b19e3779f9ULL
+
+static inline guint64
+hash_round(guint64 acc, guint64 word)
+{
+  acc += word * HASH_PRIME2;
+  acc = (acc << 31) | (acc >> 33);
+  return acc * HASH_PRIME1;
+}
+
+static inline guint64
+avalanche(guint64 hash)
+{
+  hash ^= hash >> 33;
+  hash *= HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= HASH_PRIME3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+guint64
+hough_plane_hash(const hough_plane *plane)
+{
+  guint64 hash;
+
+  hash = hash_round(HASH_PRIME3, ((guint64)plane->width << 32) |
+                    (guint32)plane->height);
+  for(int i = 0; i < plane->height; ++i)
+    {
+      guint64 word = 0;
+
+      for(int j = 0; j < plane->width; ++j)
+        {
+          word |= (guint64)hough_plane_is_dark(plane, j, i) << (j & 63);
+          if((j & 63) == 63 || j == plane->width - 1)
+            {
+              hash = hash_round(hash, word);
+              word = 0;
+            }
+        }
+    }
+
+  return avalanche(hash);
+}
+
+guint64
+hough_hash_add(guint64 hash,
+               guint64 word)
+{
+  return avalanche(hash_round(hash, word));
+}
@@ -0,0 +1,220 @@
+#ifndef HOUGHPLANE_H
+#define HOUGHPLANE_H
+
+#include <glib.h>
+
+#define PLANE_DARK_LEVEL 128
+/* adaptive threshold window is the larger side over this */
+#define ADAPTIVE_WINDOW_RATIO 4
+#define ADAPTIVE_PERCENT 15
+#define MORPH_MAX_RADIUS 63
+
+/* Read-only view of an 8-bit (gray or interleaved RGB) or a packed
+ * 1-bit image. 1-bit rows keep the leftmost pixel in the lowest bit of
+ * the first byte, a set bit is a dark pixel. */
+typedef struct hough_plane
+{
+  const guchar *pixels;
+  int width;
+  int height;
+  int rowstride;
+  int n_channels;
+  int bits;
+  int offset;
+} hough_plane;
+
+typedef enum
+{
+  /* darker than PLANE_DARK_LEVEL, like toBinary() */
+  PLANE_THRESHOLD_FIXED,
+  /* one level for the image from its histogram */
+  PLANE_THRESHOLD_OTSU,
+  /* compared with the mean of the surrounding window */
+  PLANE_THRESHOLD_ADAPTIVE
+} hough_threshold;
+
+typedef struct hough_point
+{
+  int x;
+  int y;
+} hough_point;
+
+/* Dark pixel with a light neighbour and the Sobel gradient of the dark
+ * mask there, pointing into the stroke */
+typedef struct hough_edge
+{
+  int x;
+  int y;
+  int gx;
+  int gy;
+} hough_edge;
+
+static inline int
+hough_plane_is_dark(const hough_plane *plane, int x, int y)
+{
+  const guchar *row;
+
+  row = plane->pixels + (gsize)y * plane->rowstride;
+  if(plane->bits == 1)
+    {
+      x += plane->offset;
+      return (row[x >> 3] >> (x & 7)) & 1;
+    }
+  return row[x * plane->n_channels] < PLANE_DARK_LEVEL;
+}
+
+gboolean
+hough_plane_bbox(const hough_plane *plane,
+                 int *x, int *y,
+                 int *width,
+                 int *height);
+
+void
+hough_plane_sub(const hough_plane *plane,
+                int x, int y,
+                int width, int height,
+                hough_plane *sub);
+
+gboolean
+hough_plane_crop(const hough_plane *plane,
+                 hough_plane *cropped);
+
+/* Bounding box of the dark pixels near the previous one, moved by less
+ * than margin. FALSE if the dark area is not contained in the box grown
+ * by margin and a full search is needed. */
+gboolean
+hough_plane_bbox_near(const hough_plane *plane,
+                      int *x, int *y,
+                      int *width, int *height,
+                      int margin);
+
+GArray*
+hough_plane_points(const hough_plane *plane);
+
+/* Dark mask of n pixels of row y from x on, n up to 64, pixel x in the
+ * lowest bit; 1-bit rows are read a byte at a time */
+guint64
+hough_plane_word(const hough_plane *plane,
+                 int x, int y,
+                 int n);
+
+/* Every dark pixel as the factor x factor points of its square */
+GArray*
+hough_plane_points_scaled(const hough_plane *plane,
+                          int factor);
+
+guchar*
+hough_plane_resample(const hough_plane *plane,
+                     int width, int height,
+                     hough_plane *resampled);
+
+/* Luminance of an RGB plane, 8-bit and 1-bit planes are copied */
+guchar*
+hough_plane_gray(const hough_plane *plane,
+                 hough_plane *gray);
+
+/* hough_plane_gray() into width x height bytes the caller provides */
+void
+hough_plane_gray_into(const hough_plane *plane,
+                      guchar *pixels,
+                      hough_plane *gray);
+
+/* Packed 1-bit plane of the pixels darker than PLANE_DARK_LEVEL */
+guchar*
+hough_plane_binarize(const hough_plane *plane,
+                     hough_plane *binary);
+
+/* Packed 1-bit plane of the pixels darker than level */
+guchar*
+hough_plane_binarize_level(const hough_plane *plane,
+                           int level,
+                           hough_plane *binary);
+
+/* Level splitting the luminance histogram in two classes of the least
+ * spread, suitable for hough_plane_binarize_level() */
+int
+hough_plane_otsu(const hough_plane *plane);
+
+/* Packed 1-bit plane of the pixels ADAPTIVE_PERCENT darker than the
+ * mean of the window x window square around them, 0 for the default
+ * window */
+guchar*
+hough_plane_binarize_adaptive(const hough_plane *plane,
+                              int window,
+                              hough_plane *binary);
+
+guchar*
+hough_plane_threshold(const hough_plane *plane,
+                      hough_threshold mode,
+                      hough_plane *binary);
+
+/* hough_plane_threshold() and hough_plane_bbox() with the rows split
+ * between the threads of hough-bands.h, for scans of many megapixels.
+ * The results are the same; small planes stay on the calling thread. */
+guchar*
+hough_plane_threshold_parallel(const hough_plane *plane,
+                               hough_threshold mode,
+                               hough_plane *binary);
+
+gboolean
+hough_plane_bbox_parallel(const hough_plane *plane,
+                          int *x, int *y,
+                          int *width,
+                          int *height);
+
+/* Packed 1-bit plane opened then closed with (2 radius + 1) squares:
+ * dark specks the opening square does not fit in are removed, then
+ * light holes the closing square does not fit in are filled. A radius
+ * of 0 skips that step. */
+guchar*
+hough_plane_clean(const hough_plane *plane,
+                  int open_radius,
+                  int close_radius,
+                  hough_plane *cleaned);
+
+/* hough_edge of every edge pixel in row order. Pixels outside the plane
+ * count as light. */
+GArray*
+hough_plane_edges(const hough_plane *plane);
+
+/* Packed 1-bit plane of the strokes thinned down to one pixel wide
+ * lines. The dark pixel counts before and after may be NULL. */
+guchar*
+hough_plane_thin(const hough_plane *plane,
+                 hough_plane *thinned,
+                 int *dark_before,
+                 int *dark_after);
+
+/* Points of a width x height plane turned clockwise, as seen on the
+ * image, by degrees about its centre and moved to the top left corner;
+ * *width and *height become those of the turned points. Every point
+ * moves by whole pixels, so none meet and no holes open. */
+void
+hough_points_rotate(GArray *points,
+                    double degrees,
+                    int *width,
+                    int *height);
+
+/* Packed 1-bit plane of the points of a width x height plane binned
+ * into out_width x out_height pixels, at most as many, and cropped to
+ * the dark ones. A pixel is dark if more than half of its bin is. */
+guchar*
+hough_plane_from_points(const GArray *points,
+                        int width,
+                        int height,
+                        int out_width,
+                        int out_height,
+                        hough_plane *plane);
+
+/* 64-bit hash of the dark pixel mask, the same for 8-bit and 1-bit
+ * planes of the same image */
+guint64
+hough_plane_hash(const hough_plane *plane);
+
+/* A hough_plane_hash() with word mixed in, for keys made of a plane and
+ * more; every word goes through a whole round */
+guint64
+hough_hash_add(guint64 hash,
+               guint64 word);
+
+#endif // HOUGHPLANE_H
@@ -1,6 +1,7 @@
 #include "hough-recog.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SQUARE(x) ((x) * (x))
 #define RADIAN(angle, pi) ((float)(angle) * pi / 180)
@@ -15,24 +16,44 @@
 #define DIST_DIFF_THRESHOLD 50
 #define DIAG_ANGLE 45
 #define N_OF_MAX 7
+#define REFERENCE_HEIGHT 400
+#define PYRAMID_FACTOR 4
+#define PYRAMID_MIN_PIXELS (2 * 1024 * 1024)
+#define PYRAMID_WINDOW 2
+#define PYRAMID_MARGIN 0.05
+#define SAMPLE_MIN_VOTES 8
+#define SAMPLE_STABLE_RATIO 4
+#define SAMPLE_STABLE_MIN 256
+#define SEGMENT_CELL 16
+#define SEGMENT_MAX_GAP 10
+/* a mask word holds whole cell rows */
+#define MASK_BITS 64
+#define CELL_BITS (((guint64)1 << SEGMENT_CELL) - 1)
+#define FULL_STROKE_RATIO 0.75
+#define FOLD_WINDOW 15
+#define FINE_ANGLE_STEP 5
+#define RETRY_CONFIDENCE 0.2
+#define ORIENTED_ANGLE_STEP 1
+#define ORIENTED_WINDOW 20
+#define ACCUM_TILE_BYTES (16 * 1024)
+#define BOWL_SWEEP 240
+#define ZERO_BOWL_SPAN 0.7
+#define MAX_SKEW 10
+#define DESKEW_FACTOR 2
 
 int*
-accum_matrix_from_image_with_length(const GdkPixbuf *image,
-                                    int *matrix_width,
-                                    int *matrix_height)
+accum_matrix_from_plane(const hough_plane *plane,
+                        int *matrix_width,
+                        int *matrix_height)
 {
   int *matrix, width, height;
-  int rowstride, channels, diag;
-  guchar *pixels;
+  int diag;
   int max_distance, min_distance;
   int max_angle, min_angle, index;
   int matrix_size, matr_width, matr_height;
 
-  width = gdk_pixbuf_get_width(image);
-  height = gdk_pixbuf_get_height(image);
-  rowstride = gdk_pixbuf_get_rowstride(image);
-  channels = gdk_pixbuf_get_n_channels(image);
-  pixels = gdk_pixbuf_get_pixels(image);
+  width = plane->width;
+  height = plane->height;
 
   diag = round(sqrt(SQUARE(width - 1) + SQUARE(height - 1)));
 //  diag2 = DIAG_LENGTH(width, height);
@@ -52,8 +73,7 @@ accum_matrix_from_image_with_length(const GdkPixbuf *image,
   for(int i = 0; i < height; ++i)
     for(int j = 0; j < width; ++j)
       {
-        index = i * rowstride + j * channels;
-        if(pixels[index] != 0)
+        if(!hough_plane_is_dark(plane, j, i))
           continue;
         for(int angle = min_angle; angle < max_angle/*angle <= max_angle*/; angle+= ANGLE_STEP)
           {
@@ -74,12 +94,399 @@ accum_matrix_from_image_with_length(const GdkPixbuf *image,
   return matrix;
 }
 
+/* Pyramid voting. Dark pixels are counted per factor x factor block and
+ * every block votes once with its count, in distance bins factor pixels
+ * wide. A block centre lies less than factor pixels away from any of its
+ * pixels, so a full resolution bin can only collect votes that landed
+ * within PYRAMID_WINDOW coarse bins of it; bins whose window sum stays
+ * under the vote threshold are never looked at again.
+ *
+ * The remaining bins are counted exactly one by one, walking only the
+ * pixels of their band, in the order filter_accum_matrix() scans them.
+ * Bins the filter would drop as duplicates of an accepted line are left
+ * at zero, so the matrix is sparse but filters to the same lines. */
 
-typedef struct slist_value
+static int*
+count_blocks(const hough_plane *plane,
+             int factor,
+             int *blocks_width,
+             int *blocks_height)
 {
-  int points;
-  int dist;
-} sl_value;
+  int *counts, cwidth, cheight;
+
+  cwidth = (plane->width + factor - 1) / factor;
+  cheight = (plane->height + factor - 1) / factor;
+  counts = calloc(cwidth * cheight, sizeof (int));
+
+  for(int i = 0; i < plane->height; ++i)
+    {
+      int *row = counts + (i / factor) * cwidth;
+      for(int j = 0; j < plane->width; ++j)
+        if(hough_plane_is_dark(plane, j, i))
+          row[j / factor]++;
+    }
+
+  *blocks_width = cwidth;
+  *blocks_height = cheight;
+  return counts;
+}
+
+static void
+fill_trig_tables(double *sin_table, double *cos_table)
+{
+  for(int r = 0; r < (MAX_ANGLE * 2) / ANGLE_STEP; ++r)
+    {
+      float phi = RADIAN(r * ANGLE_STEP - MAX_ANGLE, M_PI);
+      sin_table[r] = sin(phi);
+      cos_table[r] = cos(phi);
+    }
+}
+
+/* Distance bin of pixel (j, i) in the given matrix row, with the same
+ * float rounding as the exhaustive loop, or -1 when out of range */
+static inline int
+bin_of(int i, int j,
+       int row, int matr_width,
+       int max_distance,
+       double sin_phi, double cos_phi)
+{
+  float distance;
+  int index;
+
+  distance = i * sin_phi + j * cos_phi;
+  if(distance < -max_distance || distance > max_distance)
+    return -1;
+  index = row * matr_width + (distance + max_distance);
+  return index - row * matr_width;
+}
+
+/* Range of the inner coordinate that can fall into distance bins
+ * first_bin..last_bin on line o of the outer one. Walks go along the
+ * coordinate the line is closer to, so the range stays short. */
+static void
+band_span(const hough_plane *plane,
+          int by_rows, int o,
+          int first_bin, int last_bin,
+          int max_distance,
+          double sin_phi, double cos_phi,
+          int *from, int *to)
+{
+  double along, across, low, high;
+  int inner;
+
+  inner = by_rows ? plane->width : plane->height;
+  along = by_rows ? o * sin_phi : o * cos_phi;
+  across = by_rows ? cos_phi : sin_phi;
+  low = (first_bin - max_distance - PYRAMID_MARGIN - along) / across;
+  high = (last_bin - max_distance + 1 + PYRAMID_MARGIN - along) / across;
+  if(low > high)
+    {
+      double tmp = low;
+      low = high;
+      high = tmp;
+    }
+  *from = MAX(ceil(low), 0);
+  *to = MIN(floor(high), inner - 1);
+}
+
+static int
+count_bin(const hough_plane *plane,
+          int row, int matr_width,
+          int bin, int max_distance,
+          double sin_phi, double cos_phi)
+{
+  int by_rows, outer;
+  int count;
+
+  by_rows = fabs(cos_phi) >= fabs(sin_phi);
+  outer = by_rows ? plane->height : plane->width;
+  count = 0;
+
+  for(int o = 0; o < outer; ++o)
+    {
+      int from, to;
+
+      band_span(plane, by_rows, o, bin, bin, max_distance,
+                sin_phi, cos_phi, &from, &to);
+      for(int n = from; n <= to; ++n)
+        {
+          int i = by_rows ? o : n;
+          int j = by_rows ? n : o;
+
+          if(hough_plane_is_dark(plane, j, i) &&
+             bin_of(i, j, row, matr_width, max_distance,
+                    sin_phi, cos_phi) == bin)
+            count++;
+        }
+    }
+  return count;
+}
+
+int*
+accum_matrix_pyramid(const hough_plane *plane,
+                     int factor,
+                     double scale,
+                     int *matrix_width,
+                     int *matrix_height)
+{
+  int *matrix, *counts, *coarse, *kept;
+  double threshold, diff_threshold;
+  int diag, max_distance;
+  int matr_width, matr_height;
+  int cwidth, cheight, coarse_width;
+  double sin_table[MAX_ANGLE * 2 / ANGLE_STEP];
+  double cos_table[MAX_ANGLE * 2 / ANGLE_STEP];
+
+  if(factor < 2)
+    return accum_matrix_from_plane(plane, matrix_width, matrix_height);
+
+  threshold = THRESHOLD * scale;
+  diff_threshold = DIST_DIFF_THRESHOLD * scale;
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  matr_height = (MAX_ANGLE * 2) / ANGLE_STEP;
+  matrix = calloc(matr_width * matr_height, sizeof (int));
+
+  fill_trig_tables(sin_table, cos_table);
+
+  counts = count_blocks(plane, factor, &cwidth, &cheight);
+  coarse_width = matr_width / factor + 1;
+  coarse = calloc(coarse_width * matr_height, sizeof (int));
+
+  for(int bi = 0; bi < cheight; ++bi)
+    for(int bj = 0; bj < cwidth; ++bj)
+      {
+        int count = counts[bi * cwidth + bj];
+        double ci, cj;
+
+        if(count == 0)
+          continue;
+        ci = bi * factor + (factor - 1) / 2.0;
+        cj = bj * factor + (factor - 1) / 2.0;
+        for(int r = 0; r < matr_height; ++r)
+          {
+            double distance = ci * sin_table[r] + cj * cos_table[r];
+            int bin = floor((distance + max_distance) / factor);
+            coarse[r * coarse_width + CLAMP(bin, 0, coarse_width - 1)] += count;
+          }
+      }
+
+  kept = malloc(matr_width * sizeof (int));
+  for(int r = 0; r < matr_height; ++r)
+    {
+      int *coarse_row = coarse + r * coarse_width;
+      int n_kept = 0;
+
+      for(int bin = 0; bin < matr_width; ++bin)
+        {
+          int k = bin / factor;
+          int sum = 0;
+          int dist, duplicate;
+
+          for(int w = MAX(k - PYRAMID_WINDOW, 0);
+              w <= MIN(k + PYRAMID_WINDOW, coarse_width - 1); ++w)
+            sum += coarse_row[w];
+          if(sum <= threshold)
+            {
+              /* the whole coarse bin is out */
+              bin = (k + 1) * factor - 1;
+              continue;
+            }
+
+          dist = abs(bin - (matr_width - 1) / 2);
+          duplicate = 0;
+          for(int n = 0; n < n_kept && !duplicate; ++n)
+            duplicate = abs(kept[n] - dist) < diff_threshold;
+          if(duplicate)
+            continue;
+
+          matrix[r * matr_width + bin] =
+              count_bin(plane, r, matr_width, bin, max_distance,
+                        sin_table[r], cos_table[r]);
+          if(matrix[r * matr_width + bin] > threshold)
+            kept[n_kept++] = dist;
+        }
+    }
+
+  free(kept);
+  free(counts);
+  free(coarse);
+
+  *matrix_width = matr_width;
+  *matrix_height = matr_height;
+  return matrix;
+}
+
+int*
+accum_matrix_auto(const hough_plane *plane,
+                  const hough_options *options,
+                  double scale,
+                  int *matrix_width,
+                  int *matrix_height)
+{
+  int factor;
+
+  factor = options != NULL ? options->pyramid_factor : 0;
+  if(factor == 0)
+    factor = (gint64)plane->width * plane->height >= PYRAMID_MIN_PIXELS ?
+          PYRAMID_FACTOR : 1;
+  return accum_matrix_pyramid(plane, factor, scale,
+                              matrix_width, matrix_height);
+}
+
+/* Voting at fine angles. Dark pixels are gathered into horizontal runs
+ * once, then the rows are voted a tile at a time, each tile small
+ * enough to stay in the cache while all the runs go by. A run is walked
+ * along one row at a time, so its votes land in neighbouring bins.
+ * Counters are 16 bit, so twice as many rows fit a tile, and saturate
+ * rather than wrap. */
+
+typedef struct vote_run
+{
+  int y;
+  int x0;
+  int x1;
+  /* rows of the angle tables the run votes in */
+  int first;
+  int last;
+} vote_run;
+
+static GArray*
+dark_runs(const hough_plane *plane, int n_rows)
+{
+  GArray *runs;
+  vote_run run;
+
+  runs = g_array_new(FALSE, FALSE, sizeof (vote_run));
+  run.first = 0;
+  run.last = n_rows - 1;
+  for(run.y = 0; run.y < plane->height; ++run.y)
+    for(int j = 0; j < plane->width; ++j)
+      if(hough_plane_is_dark(plane, j, run.y))
+        {
+          run.x0 = j;
+          while(j + 1 < plane->width && hough_plane_is_dark(plane, j + 1, run.y))
+            j++;
+          run.x1 = j;
+          g_array_append_val(runs, run);
+        }
+  return runs;
+}
+
+static void
+vote_blocked(const vote_run *runs, int n_runs,
+             const double *sin_table, const double *cos_table,
+             int n_rows, int matr_width, int max_distance,
+             guint16 *votes)
+{
+  int tile;
+
+  tile = MAX(1, ACCUM_TILE_BYTES / (matr_width * (int)sizeof (guint16)));
+  for(int t = 0; t < n_rows; t += tile)
+    {
+      int t_last = MIN(n_rows, t + tile) - 1;
+
+      for(int k = 0; k < n_runs; ++k)
+        {
+          const vote_run *run = &runs[k];
+          int first = MAX(run->first, t);
+          int last = MIN(run->last, t_last);
+          guint16 *row = votes + first * matr_width;
+
+          for(int r = first; r <= last; ++r, row += matr_width)
+            {
+              /* the distance of bin_of(), summed in the same order; it
+               * never leaves the matrix, no pixel is a diagonal away */
+              double y_sin = run->y * sin_table[r];
+
+              for(int x = run->x0; x <= run->x1; ++x)
+                {
+                  float distance = y_sin + x * cos_table[r];
+                  guint16 *counter = row + (int)(distance + max_distance);
+
+                  *counter += *counter != G_MAXUINT16;
+                }
+            }
+        }
+    }
+}
+
+static int
+angle_tables(int angle_step, double *sin_table, double *cos_table)
+{
+  int n_rows = 0;
+
+  for(int angle = -MAX_ANGLE; angle < MAX_ANGLE; angle += angle_step)
+    {
+      float phi = RADIAN(angle, M_PI);
+
+      sin_table[n_rows] = sin(phi);
+      cos_table[n_rows] = cos(phi);
+      n_rows++;
+    }
+  return n_rows;
+}
+
+int*
+accum_matrix_angles(const hough_plane *plane,
+                    int angle_step,
+                    int *matrix_width,
+                    int *matrix_height)
+{
+  double sin_table[(MAX_ANGLE * 2) + 1], cos_table[(MAX_ANGLE * 2) + 1];
+  int *matrix;
+  int diag, max_distance, matr_width, n_rows;
+
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  n_rows = angle_tables(angle_step, sin_table, cos_table);
+  matrix = calloc(matr_width * n_rows, sizeof (int));
+
+  for(int i = 0; i < plane->height; ++i)
+    for(int j = 0; j < plane->width; ++j)
+      if(hough_plane_is_dark(plane, j, i))
+        for(int r = 0; r < n_rows; ++r)
+          {
+            int bin = bin_of(i, j, 0, matr_width, max_distance,
+                             sin_table[r], cos_table[r]);
+            if(bin >= 0)
+              matrix[r * matr_width + bin]++;
+          }
+
+  *matrix_width = matr_width;
+  *matrix_height = n_rows;
+  return matrix;
+}
+
+guint16*
+accum_matrix_blocked(const hough_plane *plane,
+                     int angle_step,
+                     int *matrix_width,
+                     int *matrix_height)
+{
+  double sin_table[(MAX_ANGLE * 2) + 1], cos_table[(MAX_ANGLE * 2) + 1];
+  GArray *runs;
+  guint16 *votes;
+  int diag, max_distance, matr_width, n_rows;
+
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  n_rows = angle_tables(angle_step, sin_table, cos_table);
+
+  runs = dark_runs(plane, n_rows);
+  votes = g_new0(guint16, (gsize)n_rows * matr_width);
+  vote_blocked((vote_run*)runs->data, runs->len,
+               sin_table, cos_table, n_rows,
+               matr_width, max_distance, votes);
+  g_array_free(runs, TRUE);
+
+  *matrix_width = matr_width;
+  *matrix_height = n_rows;
+  return votes;
+}
 
 typedef struct dist_flag_pair
 {
@@ -89,7 +496,8 @@ typedef struct dist_flag_pair
 
 static int
 contains_line (GSList *list,
-            int dist)
+            int dist,
+            double diff_threshold)
 {
   GSList *iter;
   sl_value *value;
@@ -97,7 +505,7 @@ contains_line (GSList *list,
   for(iter = list; iter != NULL; iter = iter->next)
     {
       value = (sl_value*)iter->data;
-      if(abs(value->dist - dist) < DIST_DIFF_THRESHOLD)
+      if(abs(value->dist - dist) < diff_threshold)
         return 1;
     }
   return 0;
@@ -113,23 +521,34 @@ GHashTable*
 filter_accum_matrix(const int *matrix,
                     int width,
                     int height)
+{
+  return filter_accum_matrix_scaled(matrix, width, height, 1.0);
+}
+
+GHashTable*
+filter_accum_matrix_scaled(const int *matrix,
+                           int width,
+                           int height,
+                           double scale)
 {
   GHashTable *table;
+  double threshold, diff_threshold;
   int matr_size;
   int angle, dist;
   int n_of_points;
 
-  /* TODO: добавить функцию очистки памяти */
   table = g_hash_table_new_full(g_direct_hash,
                                 g_direct_equal,
                                 NULL,
-                                NULL);
+                                free_htable_elems);
   matr_size = width * height;
+  threshold = THRESHOLD * scale;
+  diff_threshold = DIST_DIFF_THRESHOLD * scale;
 
   for(int i = 0; i < matr_size; ++i)
     {
       n_of_points = matrix[i];
-      if(n_of_points > THRESHOLD)
+      if(n_of_points > threshold)
         {
           GSList *lines = NULL;
           sl_value *new_line;
@@ -137,11 +556,14 @@ filter_accum_matrix(const int *matrix,
           angle = (i / width) * ANGLE_STEP - MAX_ANGLE;
           dist = abs((i % width) - (width - 1) / 2);
           lines = (GSList*)g_hash_table_lookup(table, GINT_TO_POINTER(angle));
-          if(!contains_line(lines, dist))
+          if(!contains_line(lines, dist, diff_threshold))
             {
               new_line = malloc(sizeof(sl_value));
               new_line->dist = dist;
               new_line->points = n_of_points;
+              new_line->bin = i % width;
+              /* the old head goes on in the new list, do not free it */
+              g_hash_table_steal(table, GINT_TO_POINTER(angle));
               lines = g_slist_prepend(lines, new_line);
               g_hash_table_insert(table, GINT_TO_POINTER(angle), lines);
             }
@@ -151,6 +573,422 @@ filter_accum_matrix(const int *matrix,
 
 }
 
+/* Progressive probabilistic voting. Dark pixels vote one at a time in
+ * random order. Once a bin has collected enough votes to project over
+ * the threshold it is counted exactly over its band and, if it really is
+ * a line, every pixel near it is taken out of the pool and its votes are
+ * withdrawn, so thick strokes stop feeding each other. Sampling stops
+ * when a long enough run of pixels brings no new line. */
+
+enum
+{
+  PIXEL_GONE,
+  PIXEL_WAITING,
+  PIXEL_VOTED
+};
+
+typedef struct sampler
+{
+  const hough_plane *plane;
+  guchar *state;
+  int *votes;
+  int *exact;
+  int matr_width;
+  int max_distance;
+  double sin_table[MAX_ANGLE * 2 / ANGLE_STEP];
+  double cos_table[MAX_ANGLE * 2 / ANGLE_STEP];
+} sampler;
+
+static void
+sampler_vote(sampler *s, int i, int j, int delta)
+{
+  for(int r = 0; r < (MAX_ANGLE * 2) / ANGLE_STEP; ++r)
+    {
+      int bin = bin_of(i, j, r, s->matr_width, s->max_distance,
+                       s->sin_table[r], s->cos_table[r]);
+      if(bin >= 0)
+        s->votes[r * s->matr_width + bin] += delta;
+    }
+}
+
+static void
+sampler_remove_band(sampler *s, int row, int first_bin, int last_bin)
+{
+  const hough_plane *plane;
+  double sin_phi, cos_phi;
+  int by_rows, outer;
+
+  plane = s->plane;
+  sin_phi = s->sin_table[row];
+  cos_phi = s->cos_table[row];
+  by_rows = fabs(cos_phi) >= fabs(sin_phi);
+  outer = by_rows ? plane->height : plane->width;
+  first_bin = MAX(first_bin, 0);
+  last_bin = MIN(last_bin, s->matr_width - 1);
+
+  for(int o = 0; o < outer; ++o)
+    {
+      int from, to;
+
+      band_span(plane, by_rows, o, first_bin, last_bin, s->max_distance,
+                sin_phi, cos_phi, &from, &to);
+      for(int n = from; n <= to; ++n)
+        {
+          int i = by_rows ? o : n;
+          int j = by_rows ? n : o;
+          guchar *state = s->state + i * plane->width + j;
+          int bin;
+
+          if(*state == PIXEL_GONE)
+            continue;
+          bin = bin_of(i, j, row, s->matr_width, s->max_distance,
+                       sin_phi, cos_phi);
+          if(bin < first_bin || bin > last_bin)
+            continue;
+          if(*state == PIXEL_VOTED)
+            sampler_vote(s, i, j, -1);
+          *state = PIXEL_GONE;
+        }
+    }
+}
+
+GHashTable*
+lines_from_plane_sampled(const hough_plane *plane,
+                         double scale,
+                         guint32 seed)
+{
+  GHashTable *table;
+  GArray *points;
+  GRand *rand;
+  sampler s;
+  double threshold, diff_threshold;
+  int diag, n_points, n_rows, stable_run, since_line;
+
+  table = g_hash_table_new_full(g_direct_hash,
+                                g_direct_equal,
+                                NULL,
+                                free_htable_elems);
+  threshold = THRESHOLD * scale;
+  diff_threshold = DIST_DIFF_THRESHOLD * scale;
+
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  s.plane = plane;
+  s.max_distance = MAX_DISTANCE(diag);
+  s.matr_width = s.max_distance * 2 + 1;
+  n_rows = (MAX_ANGLE * 2) / ANGLE_STEP;
+  fill_trig_tables(s.sin_table, s.cos_table);
+
+  points = hough_plane_points(plane);
+  n_points = points->len;
+  s.state = g_malloc0((gsize)plane->width * plane->height);
+  for(int k = 0; k < n_points; ++k)
+    {
+      hough_point *p = &g_array_index(points, hough_point, k);
+      s.state[p->y * plane->width + p->x] = PIXEL_WAITING;
+    }
+  s.votes = calloc(s.matr_width * n_rows, sizeof (int));
+  s.exact = malloc(s.matr_width * n_rows * sizeof (int));
+  for(int k = 0; k < s.matr_width * n_rows; ++k)
+    s.exact[k] = -1;
+
+  rand = g_rand_new_with_seed(seed);
+  stable_run = MAX(SAMPLE_STABLE_MIN, n_points / SAMPLE_STABLE_RATIO);
+  since_line = 0;
+
+  for(int k = 0; k < n_points && since_line < stable_run; ++k)
+    {
+      hough_point *points_data = (hough_point*)points->data;
+      hough_point p;
+      int pick;
+
+      /* partial Fisher-Yates shuffle */
+      pick = g_rand_int_range(rand, k, n_points);
+      p = points_data[pick];
+      points_data[pick] = points_data[k];
+      points_data[k] = p;
+
+      if(s.state[p.y * plane->width + p.x] != PIXEL_WAITING)
+        continue;
+      s.state[p.y * plane->width + p.x] = PIXEL_VOTED;
+      sampler_vote(&s, p.y, p.x, 1);
+      since_line++;
+
+      for(int r = 0; r < n_rows; ++r)
+        {
+          int bin, index, angle, dist;
+          GSList *lines;
+          sl_value *new_line;
+
+          bin = bin_of(p.y, p.x, r, s.matr_width, s.max_distance,
+                       s.sin_table[r], s.cos_table[r]);
+          if(bin < 0)
+            continue;
+          index = r * s.matr_width + bin;
+          if(s.exact[index] >= 0 ||
+             s.votes[index] < SAMPLE_MIN_VOTES ||
+             (double)s.votes[index] * n_points / (k + 1) <= threshold)
+            continue;
+
+          angle = r * ANGLE_STEP - MAX_ANGLE;
+          dist = abs(bin - (s.matr_width - 1) / 2);
+          lines = (GSList*)g_hash_table_lookup(table, GINT_TO_POINTER(angle));
+          s.exact[index] = contains_line(lines, dist, diff_threshold) ? 0 :
+              count_bin(plane, r, s.matr_width, bin, s.max_distance,
+                        s.sin_table[r], s.cos_table[r]);
+          if(s.exact[index] <= threshold)
+            continue;
+
+          new_line = malloc(sizeof(sl_value));
+          new_line->dist = dist;
+          new_line->points = s.exact[index];
+          new_line->bin = bin;
+          g_hash_table_steal(table, GINT_TO_POINTER(angle));
+          lines = g_slist_prepend(lines, new_line);
+          g_hash_table_insert(table, GINT_TO_POINTER(angle), lines);
+
+          sampler_remove_band(&s, r, bin - diff_threshold,
+                              bin + diff_threshold);
+          since_line = 0;
+        }
+    }
+
+  g_rand_free(rand);
+  g_array_free(points, TRUE);
+  g_free(s.state);
+  free(s.votes);
+  free(s.exact);
+  return table;
+}
+
+/* Dark pixels read by SEGMENT_CELL square cells of a mask of one bit
+ * per pixel, so that a line walk only looks at the cells it crosses */
+typedef struct point_grid
+{
+  int n_cols;
+  int n_rows;
+  int height;
+  const guint64 *mask;
+  int mask_words;
+  guint64 *own_mask;
+} point_grid;
+
+static void
+point_grid_from_mask(point_grid *grid,
+                     const guint64 *mask, int mask_words,
+                     int width, int height)
+{
+  grid->n_cols = (width + SEGMENT_CELL - 1) / SEGMENT_CELL;
+  grid->n_rows = (height + SEGMENT_CELL - 1) / SEGMENT_CELL;
+  grid->height = height;
+  grid->mask = mask;
+  grid->mask_words = mask_words;
+  grid->own_mask = NULL;
+}
+
+static void
+point_grid_init(point_grid *grid, const hough_plane *plane)
+{
+  guint64 *mask;
+  int mask_words;
+
+  mask_words = (plane->width + MASK_BITS - 1) / MASK_BITS;
+  mask = g_new(guint64, (gsize)mask_words * plane->height);
+  for(int i = 0; i < plane->height; ++i)
+    for(int w = 0; w < mask_words; ++w)
+      mask[(gsize)i * mask_words + w] =
+          hough_plane_word(plane, w * MASK_BITS, i,
+                           MIN(MASK_BITS, plane->width - w * MASK_BITS));
+  point_grid_from_mask(grid, mask, mask_words, plane->width, plane->height);
+  grid->own_mask = mask;
+}
+
+static void
+point_grid_clear(point_grid *grid)
+{
+  g_free(grid->own_mask);
+}
+
+typedef struct line_point
+{
+  double t;
+  hough_point point;
+} line_point;
+
+static int
+compare_line_points(const void *a, const void *b)
+{
+  double ta = ((const line_point*)a)->t;
+  double tb = ((const line_point*)b)->t;
+
+  return (ta > tb) - (ta < tb);
+}
+
+/* Collects the points of distance bin `bin' of matrix row `row' with
+ * their position along the line */
+static GArray*
+walk_line(const point_grid *grid,
+          int row, int bin,
+          int max_distance,
+          int matr_width,
+          double sin_phi, double cos_phi)
+{
+  GArray *found;
+  int by_rows, n_strips, n_cells;
+  double across;
+
+  found = g_array_new(FALSE, FALSE, sizeof(line_point));
+  by_rows = fabs(cos_phi) >= fabs(sin_phi);
+  n_strips = by_rows ? grid->n_rows : grid->n_cols;
+  n_cells = by_rows ? grid->n_cols : grid->n_rows;
+  across = by_rows ? cos_phi : sin_phi;
+
+  for(int strip = 0; strip < n_strips; ++strip)
+    {
+      double low, high;
+      int first, last;
+
+      low = G_MAXDOUBLE;
+      high = -G_MAXDOUBLE;
+      for(int end = 0; end < 2; ++end)
+        {
+          int o = strip * SEGMENT_CELL + end * (SEGMENT_CELL - 1);
+          double along = by_rows ? o * sin_phi : o * cos_phi;
+          double a = (bin - max_distance - PYRAMID_MARGIN - along) / across;
+          double b = (bin - max_distance + 1 + PYRAMID_MARGIN - along) / across;
+
+          low = MIN(low, MIN(a, b));
+          high = MAX(high, MAX(a, b));
+        }
+      first = MAX(floor(low / SEGMENT_CELL), 0);
+      last = MIN(floor(high / SEGMENT_CELL), n_cells - 1);
+
+      for(int c = first; c <= last; ++c)
+        {
+          int x0 = (by_rows ? c : strip) * SEGMENT_CELL;
+          int y0 = (by_rows ? strip : c) * SEGMENT_CELL;
+          hough_point p;
+
+          for(p.y = y0; p.y < MIN(y0 + SEGMENT_CELL, grid->height); ++p.y)
+            {
+              guint64 bits = grid->mask[(gsize)p.y * grid->mask_words +
+                                        x0 / MASK_BITS];
+
+              for(bits = bits >> (x0 % MASK_BITS) & CELL_BITS; bits != 0;
+                  bits &= bits - 1)
+                {
+                  line_point lp;
+
+                  p.x = x0 + __builtin_ctzll(bits);
+                  if(bin_of(p.y, p.x, row, matr_width, max_distance,
+                            sin_phi, cos_phi) != bin)
+                    continue;
+                  lp.t = p.y * cos_phi - p.x * sin_phi;
+                  lp.point = p;
+                  g_array_append_val(found, lp);
+                }
+            }
+        }
+    }
+  return found;
+}
+
+/* Longest run of points along the line with no gap wider than max_gap */
+static void
+longest_run(GArray *found, double max_gap, hough_segment *segment)
+{
+  line_point *lp;
+  int best_first, best_last, first;
+
+  segment->points = 0;
+  segment->length = 0;
+  if(found->len == 0)
+    return;
+
+  lp = (line_point*)found->data;
+  qsort(lp, found->len, sizeof(line_point), compare_line_points);
+  best_first = best_last = first = 0;
+  for(guint k = 1; k <= found->len; ++k)
+    {
+      if(k < found->len && lp[k].t - lp[k - 1].t <= max_gap)
+        continue;
+      if(lp[k - 1].t - lp[first].t > lp[best_last].t - lp[best_first].t)
+        {
+          best_first = first;
+          best_last = k - 1;
+        }
+      first = k;
+    }
+
+  segment->x0 = lp[best_first].point.x;
+  segment->y0 = lp[best_first].point.y;
+  segment->x1 = lp[best_last].point.x;
+  segment->y1 = lp[best_last].point.y;
+  segment->length = round(lp[best_last].t - lp[best_first].t) + 1;
+  segment->points = best_last - best_first + 1;
+}
+
+/* Segments of the lines of a width x height plane from its grid */
+static GArray*
+grid_segments(const point_grid *grid,
+              int width, int height,
+              GHashTable *lines,
+              double scale)
+{
+  GArray *segments;
+  GHashTableIter iter;
+  gpointer key, value;
+  double sin_table[MAX_ANGLE * 2 / ANGLE_STEP];
+  double cos_table[MAX_ANGLE * 2 / ANGLE_STEP];
+  double max_gap;
+  int diag, max_distance, matr_width;
+
+  segments = g_array_new(FALSE, FALSE, sizeof(hough_segment));
+  diag = round(sqrt(SQUARE(width - 1) + SQUARE(height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  max_gap = MAX(SEGMENT_MAX_GAP * scale, 2);
+  fill_trig_tables(sin_table, cos_table);
+
+  g_hash_table_iter_init(&iter, lines);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      int angle = GPOINTER_TO_INT(key);
+      int row = (angle + MAX_ANGLE) / ANGLE_STEP;
+
+      for(GSList *l = (GSList*)value; l != NULL; l = l->next)
+        {
+          sl_value *line = (sl_value*)l->data;
+          hough_segment segment;
+          GArray *found;
+
+          found = walk_line(grid, row, line->bin, max_distance, matr_width,
+                            sin_table[row], cos_table[row]);
+          longest_run(found, max_gap, &segment);
+          g_array_free(found, TRUE);
+          if(segment.points == 0)
+            continue;
+          segment.angle = angle;
+          segment.dist = line->dist;
+          g_array_append_val(segments, segment);
+        }
+    }
+  return segments;
+}
+
+GArray*
+extract_segments(const hough_plane *plane,
+                 GHashTable *lines,
+                 double scale)
+{
+  GArray *segments;
+  point_grid grid;
+
+  point_grid_init(&grid, plane);
+  segments = grid_segments(&grid, plane->width, plane->height, lines, scale);
+  point_grid_clear(&grid);
+  return segments;
+}
+
 static void
 count_lines (gpointer key,
      gpointer value,
@@ -251,11 +1089,102 @@ count_points_by_angle (gpointer key,
     }
 }
 
-int
-identify_number(GdkPixbuf *image, GHashTable *table)
+/* Vertical middle of the strongest diagonal segment, -1 without one */
+static int
+diag_segment_middle(GArray *segments)
+{
+  hough_segment *best = NULL;
+
+  for(guint k = 0; k < segments->len; ++k)
+    {
+      hough_segment *segment = &g_array_index(segments, hough_segment, k);
+      if(abs(segment->angle) == DIAG_ANGLE &&
+         (best == NULL || segment->points > best->points))
+        best = segment;
+    }
+  return best != NULL ? (best->y0 + best->y1) / 2 : -1;
+}
+
+static int
+longest_vertical_segment(GArray *segments)
+{
+  int length = 0;
+
+  for(guint k = 0; k < segments->len; ++k)
+    {
+      hough_segment *segment = &g_array_index(segments, hough_segment, k);
+      if(segment->angle == 0)
+        length = MAX(length, segment->length);
+    }
+  return length;
+}
+
+int
+identify_number_by_size(int img_width,
+                        int img_height,
+                        GHashTable *table)
+{
+  return identify_number_by_segments(img_width, img_height, table, NULL);
+}
+
+/* Handwritten 0, 6, 8 and 9 have round bowls the lines miss. A bowl
+ * spanning most of the height is a 0, two stacked bowls an 8, and a
+ * single one a 6 or a 9 by the half it is in. */
+static int
+identify_number_by_bowls(int img_height, GArray *arcs)
+{
+  hough_arc *first = NULL;
+
+  for(guint k = 0; k < arcs->len; ++k)
+    {
+      hough_arc *arc = &g_array_index(arcs, hough_arc, k);
+
+      if(arc->sweep >= BOWL_SWEEP &&
+         2 * arc->radius_y >= img_height * ZERO_BOWL_SPAN)
+        return 0;
+    }
+  for(guint k = 0; k < arcs->len; ++k)
+    {
+      hough_arc *arc = &g_array_index(arcs, hough_arc, k);
+
+      if(arc->sweep < BOWL_SWEEP)
+        continue;
+      if(first == NULL)
+        first = arc;
+      else if(abs(first->cy - arc->cy) > img_height / 4)
+        return 8;
+    }
+  if(first == NULL)
+    return -1;
+  return first->cy > img_height / 2 ? 6 : 9;
+}
+
+int
+identify_number_by_features(int img_width,
+                            int img_height,
+                            GHashTable *table,
+                            GArray *segments,
+                            GArray *arcs)
+{
+  if(arcs != NULL)
+    {
+      int digit = identify_number_by_bowls(img_height, arcs);
+
+      if(digit >= 0)
+        return digit;
+    }
+  return identify_number_by_segments(img_width, img_height,
+                                     table, segments);
+}
+
+int
+identify_number_by_segments(int img_width,
+                            int img_height,
+                            GHashTable *table,
+                            GArray *segments)
 {
   int n_of_lines, n_of_diags;
-  int has_diag, img_width, img_height;
+  int has_diag;
   int img_diag_length;
   int first_diag_line_dist;
 #define FOREACH(seq, func, acc)\
@@ -264,8 +1193,6 @@ identify_number(GdkPixbuf *image, GHashTable *table)
     g_hash_table_foreach(seq, func, &acc);\
   }
 
-  img_width = gdk_pixbuf_get_width(image);
-  img_height = gdk_pixbuf_get_height(image);
   img_diag_length = DIAG_LENGTH(img_width,
                                 img_height);
   FOREACH(table, count_lines, n_of_lines);
@@ -299,7 +1226,16 @@ identify_number(GdkPixbuf *image, GHashTable *table)
     case 5:
       {
         FOREACH(table, check_diag, has_diag);
-        if(has_diag)
+        if(has_diag && segments != NULL &&
+           diag_segment_middle(segments) >= 0)
+          {
+            /* the diagonal stroke of 6 is in the upper half */
+            if(diag_segment_middle(segments) < img_height / 2)
+              return 6;
+            else
+              return 9;
+          }
+        else if(has_diag)
           {
             FOREACH(table, get_first_diag_dist, first_diag_line_dist);
             if(first_diag_line_dist < img_diag_length / 2)
@@ -307,6 +1243,15 @@ identify_number(GdkPixbuf *image, GHashTable *table)
             else
               return 9;
           }
+        else if(segments != NULL && longest_vertical_segment(segments) > 0)
+          {
+            /* only 8 has a vertical stroke through the whole height */
+            if(longest_vertical_segment(segments) <
+               img_height * FULL_STROKE_RATIO)
+              return 5;
+            else
+              return 8;
+          }
         else
           {
             as_pair pair;
@@ -326,3 +1271,1012 @@ identify_number(GdkPixbuf *image, GHashTable *table)
 
   return -1;
 }
+
+void
+hough_options_init(hough_options *options)
+{
+  options->vote_mode = HOUGH_VOTE_FULL;
+  options->classifier = HOUGH_CLASSIFY_LINES;
+  options->fine_angle_step = FINE_ANGLE_STEP;
+  options->retry_confidence = RETRY_CONFIDENCE;
+  options->thin = FALSE;
+  options->arcs = FALSE;
+  options->deskew = FALSE;
+  options->open_radius = 0;
+  options->close_radius = 0;
+  options->keep_votes = FALSE;
+  options->pyramid_factor = 0;
+  options->canonical_height = CANONICAL_HEIGHT;
+  options->seed = 0;
+  options->cache = NULL;
+}
+
+/* How far the weakest line of the digit clears the vote threshold:
+ * 0 right at the threshold, approaching 1 for strong lines */
+static double
+lines_confidence(GHashTable *table, double threshold)
+{
+  GHashTableIter iter;
+  gpointer value;
+  int weakest = -1;
+
+  g_hash_table_iter_init(&iter, table);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+    for(GSList *l = (GSList*)value; l != NULL; l = l->next)
+      {
+        sl_value *line = (sl_value*)l->data;
+        if(weakest < 0 || line->points < weakest)
+          weakest = line->points;
+      }
+  if(weakest <= 0)
+    return 0;
+  return MAX(0, 1 - threshold / weakest);
+}
+
+int
+recognize_plane(const hough_plane *plane,
+                const hough_options *options)
+{
+  return recognize_plane_confidence(plane, options, NULL);
+}
+
+/* The plane to crop the digit from, with specks and holes cleaned up
+ * if the options ask for it */
+static guchar*
+clean_plane(const hough_plane *plane,
+            const hough_options *options,
+            hough_plane *cleaned)
+{
+  if(options == NULL ||
+     (options->open_radius <= 0 && options->close_radius <= 0))
+    {
+      *cleaned = *plane;
+      return NULL;
+    }
+  return hough_plane_clean(plane, options->open_radius,
+                           options->close_radius, cleaned);
+}
+
+int
+recognize_plane_confidence(const hough_plane *plane,
+                           const hough_options *options,
+                           double *confidence)
+{
+  hough_plane cleaned, cropped;
+  guchar *buffer;
+  int number;
+
+  buffer = clean_plane(plane, options, &cleaned);
+  if(!hough_plane_crop(&cleaned, &cropped))
+    {
+      if(confidence != NULL)
+        *confidence = 0;
+      g_free(buffer);
+      return -1;
+    }
+  number = recognize_cropped(&cropped, options, confidence);
+  g_free(buffer);
+  return number;
+}
+
+/* Crop hash mixed with everything in the options that changes the
+ * result, so one cache may serve several option sets */
+static guint64
+cache_key(const hough_plane *crop, const hough_options *options)
+{
+  guint64 key, confidence;
+
+  /* the radii only act before cropping and the votes kept do not change
+   * the digit, so they are left out */
+  memcpy(&confidence, &options->retry_confidence, sizeof (confidence));
+  key = hough_plane_hash(crop);
+  key = hough_hash_add(key, options->vote_mode);
+  key = hough_hash_add(key, options->classifier);
+  key = hough_hash_add(key, options->pyramid_factor);
+  key = hough_hash_add(key, options->canonical_height);
+  key = hough_hash_add(key, options->seed);
+  key = hough_hash_add(key, options->fine_angle_step);
+  key = hough_hash_add(key, confidence);
+  key = hough_hash_add(key, options->thin);
+  key = hough_hash_add(key, options->arcs);
+  key = hough_hash_add(key, options->deskew);
+  return key;
+}
+
+/* Row of the folded matrix the votes at angle go to, -1 if the angle is
+ * further than FOLD_WINDOW from every direction. 90 degrees is -90 with
+ * the distance reversed, *flip tells to reverse it. */
+static int
+fold_row(int angle, int matr_height, int *flip)
+{
+  int nearest;
+
+  nearest = (int)round((double)(angle + MAX_ANGLE) / ANGLE_STEP);
+  if(abs(angle + MAX_ANGLE - nearest * ANGLE_STEP) > FOLD_WINDOW)
+    return -1;
+  *flip = nearest == matr_height;
+  return *flip ? 0 : nearest;
+}
+
+/* Puts the votes of one angle into its folded row if their peaks are
+ * sharper than those of the angle already there */
+static void
+fold_votes(int *matrix, double *sharpness,
+           const guint16 *row_votes, int row, int flip,
+           int matr_width)
+{
+  double sum;
+  int *folded;
+
+  sum = 0;
+  for(int bin = 0; bin < matr_width; ++bin)
+    sum += (double)row_votes[bin] * row_votes[bin];
+  if(sum <= sharpness[row])
+    return;
+  sharpness[row] = sum;
+  folded = matrix + row * matr_width;
+  for(int bin = 0; bin < matr_width; ++bin)
+    folded[flip ? matr_width - 1 - bin : bin] = row_votes[bin];
+}
+
+/* Angles every angle_step degrees that fold_row() keeps, returns how
+ * many. The arrays hold (MAX_ANGLE * 2) / angle_step + 1 entries. */
+static int
+fold_angles(int angle_step, int *angles,
+            double *sin_table, double *cos_table)
+{
+  int n_rows, flip;
+
+  n_rows = 0;
+  for(int angle = -MAX_ANGLE; angle < MAX_ANGLE; angle += angle_step)
+    if(fold_row(angle, (MAX_ANGLE * 2) / ANGLE_STEP, &flip) >= 0)
+      {
+        float phi = RADIAN(angle, M_PI);
+
+        angles[n_rows] = angle;
+        sin_table[n_rows] = sin(phi);
+        cos_table[n_rows] = cos(phi);
+        n_rows++;
+      }
+  return n_rows;
+}
+
+/* Folds blocked votes of the given angles into a matrix with a row for
+ * each of the four directions */
+static int*
+fold_matrix(const guint16 *votes, const int *angles, int n_rows,
+            int matr_width)
+{
+  double sharpness[(MAX_ANGLE * 2) / ANGLE_STEP];
+  int *matrix, matr_height;
+
+  matr_height = (MAX_ANGLE * 2) / ANGLE_STEP;
+  matrix = calloc(matr_width * matr_height, sizeof (int));
+  for(int row = 0; row < matr_height; ++row)
+    sharpness[row] = -1;
+  for(int r = 0; r < n_rows; ++r)
+    {
+      int flip, row = fold_row(angles[r], matr_height, &flip);
+
+      fold_votes(matrix, sharpness, votes + r * matr_width,
+                 row, flip, matr_width);
+    }
+  return matrix;
+}
+
+/* Votes at every angle_step degrees and, for each of the four
+ * directions the identification rules know, keeps the row of the angle
+ * within FOLD_WINDOW of it with the sharpest peaks. The strokes of a
+ * digit tilted by a few degrees then line up again. */
+static int*
+accum_matrix_folded(const hough_plane *plane,
+                    int angle_step,
+                    int *matrix_width,
+                    int *matrix_height)
+{
+  int angles[(MAX_ANGLE * 2) + 1];
+  double sin_table[(MAX_ANGLE * 2) + 1], cos_table[(MAX_ANGLE * 2) + 1];
+  GArray *runs;
+  guint16 *votes;
+  int *matrix;
+  int diag, max_distance, matr_width, n_rows;
+
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  n_rows = fold_angles(angle_step, angles, sin_table, cos_table);
+
+  runs = dark_runs(plane, n_rows);
+  votes = g_new0(guint16, (gsize)n_rows * matr_width);
+  vote_blocked((vote_run*)runs->data, runs->len,
+               sin_table, cos_table, n_rows,
+               matr_width, max_distance, votes);
+  matrix = fold_matrix(votes, angles, n_rows, matr_width);
+  g_free(votes);
+  g_array_free(runs, TRUE);
+
+  *matrix_width = matr_width;
+  *matrix_height = (MAX_ANGLE * 2) / ANGLE_STEP;
+  return matrix;
+}
+
+/* Appends a run voting at angle indices first..last, shorter than half
+ * a turn but possibly outside of it, as runs over the rows kept of those
+ * angles */
+static void
+add_oriented_run(GArray *runs, vote_run run,
+                 const int *row_after, const int *row_before)
+{
+  enum { N_ANGLES = (MAX_ANGLE * 2) / ORIENTED_ANGLE_STEP };
+
+  if(run.first < 0)
+    {
+      run.first += N_ANGLES;
+      run.last += N_ANGLES;
+    }
+  else if(run.first >= N_ANGLES)
+    {
+      run.first -= N_ANGLES;
+      run.last -= N_ANGLES;
+    }
+  if(run.last >= N_ANGLES)
+    {
+      vote_run wrapped = run;
+
+      wrapped.first = 0;
+      wrapped.last = run.last - N_ANGLES;
+      add_oriented_run(runs, wrapped, row_after, row_before);
+      run.last = N_ANGLES - 1;
+    }
+  run.first = row_after[run.first];
+  run.last = row_before[run.last];
+  if(run.first <= run.last)
+    g_array_append_val(runs, run);
+}
+
+/* Edge oriented voting. Only the edges of the plane vote, and only
+ * within ORIENTED_WINDOW degrees of the normal to the edge given by the
+ * Sobel gradient of the dark mask, every ORIENTED_ANGLE_STEP degrees.
+ * The inside of a stroke is silent, and
+ * both of its edges peak in bins closer than the line spacing, so the
+ * filter sees a single line as strong as with every pixel voting. Edge
+ * pixels with no gradient, such as those of one pixel wide strokes,
+ * vote at every angle. The fine rows are folded like in
+ * accum_matrix_folded(). */
+static int*
+accum_matrix_oriented(const hough_plane *plane,
+                      GArray *edges,
+                      int *matrix_width,
+                      int *matrix_height)
+{
+  enum { N_ANGLES = (MAX_ANGLE * 2) / ORIENTED_ANGLE_STEP };
+  int angles[N_ANGLES + 1], row_after[N_ANGLES], row_before[N_ANGLES];
+  double sin_table[N_ANGLES + 1], cos_table[N_ANGLES + 1];
+  GArray *runs;
+  vote_run pending;
+  guint16 *votes;
+  int *matrix;
+  int diag, max_distance, matr_width, n_rows;
+
+  diag = round(sqrt(SQUARE(plane->width - 1) + SQUARE(plane->height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  n_rows = fold_angles(ORIENTED_ANGLE_STEP, angles, sin_table, cos_table);
+  for(int k = 0, r = 0; k < N_ANGLES; ++k)
+    {
+      while(r < n_rows &&
+            angles[r] < k * ORIENTED_ANGLE_STEP - MAX_ANGLE)
+        r++;
+      row_after[k] = r;
+      row_before[k] = r < n_rows &&
+          angles[r] == k * ORIENTED_ANGLE_STEP - MAX_ANGLE ? r : r - 1;
+    }
+
+  /* neighbouring edge pixels with the same normal vote as a run */
+  runs = g_array_new(FALSE, FALSE, sizeof (vote_run));
+  pending.x1 = -2;
+  for(guint k = 0; k < edges->len; ++k)
+    {
+      const hough_edge *edge = &g_array_index(edges, hough_edge, k);
+      int first, last;
+
+      if(edge->gx == 0 && edge->gy == 0)
+        {
+          first = 0;
+          last = N_ANGLES - 1;
+        }
+      else
+        {
+          /* normals differing by half a turn are the same line */
+          int normal = (int)round(atan2(edge->gy, edge->gx) * 180 / M_PI);
+
+          first = (normal - ORIENTED_WINDOW + MAX_ANGLE) /
+              ORIENTED_ANGLE_STEP;
+          last = (normal + ORIENTED_WINDOW + MAX_ANGLE) /
+              ORIENTED_ANGLE_STEP;
+        }
+      if(pending.y == edge->y && pending.x1 == edge->x - 1 &&
+         pending.first == first && pending.last == last)
+        {
+          pending.x1 = edge->x;
+          continue;
+        }
+      if(pending.x1 >= 0)
+        add_oriented_run(runs, pending, row_after, row_before);
+      pending.y = edge->y;
+      pending.x0 = edge->x;
+      pending.x1 = edge->x;
+      pending.first = first;
+      pending.last = last;
+    }
+  if(pending.x1 >= 0)
+    add_oriented_run(runs, pending, row_after, row_before);
+
+  votes = g_new0(guint16, (gsize)n_rows * matr_width);
+  vote_blocked((vote_run*)runs->data, runs->len,
+               sin_table, cos_table, n_rows,
+               matr_width, max_distance, votes);
+  matrix = fold_matrix(votes, angles, n_rows, matr_width);
+  g_free(votes);
+  g_array_free(runs, TRUE);
+
+  *matrix_width = matr_width;
+  *matrix_height = (MAX_ANGLE * 2) / ANGLE_STEP;
+  return matrix;
+}
+
+int
+estimate_skew(GArray *edges, int width, int height)
+{
+  enum { N_SKEWS = 2 * MAX_SKEW + 1 };
+  double sin_table[2 * N_SKEWS], cos_table[2 * N_SKEWS];
+  double best_sharpness;
+  GArray *runs;
+  vote_run pending;
+  guint16 *votes;
+  int diag, max_distance, matr_width, best;
+
+  diag = round(sqrt(SQUARE(width - 1) + SQUARE(height - 1)));
+  max_distance = MAX_DISTANCE(diag);
+  matr_width = max_distance * 2 + 1;
+  /* the first N_SKEWS rows hold the normals of the columns turned by
+   * -MAX_SKEW to MAX_SKEW, the others those of the rows */
+  for(int r = 0; r < 2 * N_SKEWS; ++r)
+    {
+      float phi = RADIAN(r % N_SKEWS - MAX_SKEW - r / N_SKEWS * MAX_ANGLE,
+                         M_PI);
+
+      sin_table[r] = sin(phi);
+      cos_table[r] = cos(phi);
+    }
+
+  /* edges of the columns vote for columns and those of the rows for
+   * rows, the slanted ones not at all */
+  runs = g_array_new(FALSE, FALSE, sizeof (vote_run));
+  pending.x1 = -2;
+  for(guint k = 0; k < edges->len; ++k)
+    {
+      const hough_edge *edge = &g_array_index(edges, hough_edge, k);
+      int first;
+
+      if(2 * abs(edge->gy) <= abs(edge->gx) && edge->gx != 0)
+        first = 0;
+      else if(2 * abs(edge->gx) <= abs(edge->gy) && edge->gy != 0)
+        first = N_SKEWS;
+      else
+        continue;
+      if(pending.y == edge->y && pending.x1 == edge->x - 1 &&
+         pending.first == first)
+        {
+          pending.x1 = edge->x;
+          continue;
+        }
+      if(pending.x1 >= 0)
+        g_array_append_val(runs, pending);
+      pending.y = edge->y;
+      pending.x0 = edge->x;
+      pending.x1 = edge->x;
+      pending.first = first;
+      pending.last = first + N_SKEWS - 1;
+    }
+  if(pending.x1 >= 0)
+    g_array_append_val(runs, pending);
+
+  votes = g_new0(guint16, (gsize)2 * N_SKEWS * matr_width);
+  vote_blocked((vote_run*)runs->data, runs->len,
+               sin_table, cos_table, 2 * N_SKEWS,
+               matr_width, max_distance, votes);
+
+  /* straight strokes pile their edges into few bins, so the turn with
+   * the sharpest peaks wins, the smallest one of equals */
+  best = 0;
+  best_sharpness = -1;
+  for(int n = 0; n < N_SKEWS; ++n)
+    {
+      int skew = n % 2 ? (n + 1) / 2 : -n / 2;
+      double sum = 0;
+
+      for(int family = 0; family < 2; ++family)
+        {
+          const guint16 *row = votes + (family * N_SKEWS + skew + MAX_SKEW) *
+              matr_width;
+
+          for(int bin = 0; bin < matr_width; ++bin)
+            sum += (double)row[bin] * row[bin];
+        }
+      if(sum > best_sharpness)
+        {
+          best_sharpness = sum;
+          best = skew;
+        }
+    }
+  g_free(votes);
+  g_array_free(runs, TRUE);
+  return best;
+}
+
+/* Recognizes a crop already brought to the canonical size by its lines
+ * voted every angle_step degrees */
+static void
+recognize_lines(const hough_plane *cropped,
+                const hough_options *options,
+                double scale,
+                int angle_step,
+                hough_result *result)
+{
+  GHashTable *filtered;
+  GArray *edges;
+  int *matrix, width, height;
+
+  matrix = NULL;
+  /* the oriented votes and the arcs go by the same edges */
+  edges = NULL;
+  if(options->vote_mode == HOUGH_VOTE_ORIENTED || options->arcs)
+    edges = hough_plane_edges(cropped);
+
+  if(options->vote_mode == HOUGH_VOTE_ORIENTED)
+    {
+      angle_step = ORIENTED_ANGLE_STEP;
+      matrix = accum_matrix_oriented(cropped, edges, &width, &height);
+      filtered = filter_accum_matrix_scaled(matrix, width, height, scale);
+    }
+  else if(angle_step != ANGLE_STEP)
+    {
+      matrix = accum_matrix_folded(cropped, angle_step, &width, &height);
+      filtered = filter_accum_matrix_scaled(matrix, width, height, scale);
+    }
+  else if(options->vote_mode == HOUGH_VOTE_SAMPLED)
+    filtered = lines_from_plane_sampled(cropped, scale, options->seed);
+  else
+    {
+      matrix = accum_matrix_auto(cropped, options, scale, &width, &height);
+      filtered = filter_accum_matrix_scaled(matrix, width, height, scale);
+    }
+  result->votes = NULL;
+  if(matrix != NULL && options->keep_votes)
+    {
+      result->votes = matrix;
+      result->votes_width = width;
+      result->votes_height = height;
+      result->votes_scale = scale;
+    }
+  else
+    {
+      free(matrix);
+      result->votes_width = result->votes_height = 0;
+      result->votes_scale = 0;
+    }
+  result->arcs = NULL;
+  if(options->arcs)
+    result->arcs = detect_arcs(edges, cropped->width, cropped->height);
+  if(edges != NULL)
+    g_array_free(edges, TRUE);
+
+  result->lines = extract_segments(cropped, filtered, scale);
+  result->digit = identify_number_by_features(cropped->width,
+                                              cropped->height,
+                                              filtered, result->lines,
+                                              result->arcs);
+  result->confidence = result->digit >= 0 ?
+      lines_confidence(filtered, THRESHOLD * scale) : 0;
+  result->angle_step = angle_step;
+  result->crop_width = cropped->width;
+  result->crop_height = cropped->height;
+  g_hash_table_destroy(filtered);
+}
+
+/* The recognized digit first, then the others most like their
+ * prototypes */
+static void
+rank_candidates(const hough_plane *cropped, hough_result *result)
+{
+  double scores[TEMPLATE_DIGITS];
+  int n;
+
+  template_scores(cropped, scores);
+  n = 0;
+  if(result->digit >= 0)
+    {
+      result->candidates[n].digit = result->digit;
+      result->candidates[n++].score = scores[result->digit];
+      scores[result->digit] = -G_MAXDOUBLE;
+    }
+  for(; n < HOUGH_CANDIDATES; ++n)
+    {
+      int best = 0;
+
+      for(int digit = 1; digit < TEMPLATE_DIGITS; ++digit)
+        if(scores[digit] > scores[best])
+          best = digit;
+      result->candidates[n].digit = best;
+      result->candidates[n].score = scores[best];
+      scores[best] = -G_MAXDOUBLE;
+    }
+}
+
+static GMutex thin_lock;
+static hough_stage_stats thin_totals;
+
+static guchar*
+thin_crop(const hough_plane *cropped, hough_plane *thinned)
+{
+  guchar *buffer;
+  gint64 start;
+  int before, after;
+
+  start = g_get_monotonic_time();
+  buffer = hough_plane_thin(cropped, thinned, &before, &after);
+
+  g_mutex_lock(&thin_lock);
+  thin_totals.calls++;
+  thin_totals.usec += g_get_monotonic_time() - start;
+  thin_totals.pixels_in += before;
+  thin_totals.pixels_out += after;
+  g_mutex_unlock(&thin_lock);
+  return buffer;
+}
+
+void
+hough_thin_stats(hough_stage_stats *stats)
+{
+  g_mutex_lock(&thin_lock);
+  *stats = thin_totals;
+  g_mutex_unlock(&thin_lock);
+}
+
+/* Votes and line spacing grow with the digit, so the crop is brought
+ * down to the canonical height. FALSE if nothing is left of it. */
+static gboolean
+canonical_crop(const hough_plane *crop,
+               const hough_options *options,
+               hough_plane *cropped,
+               guchar **buffer)
+{
+  hough_plane normalized;
+  int canonical_width;
+
+  *cropped = *crop;
+  *buffer = NULL;
+  if(options->canonical_height <= 0 ||
+     crop->height <= options->canonical_height)
+    return TRUE;
+  canonical_width = MAX(1, (gint64)crop->width *
+                        options->canonical_height / crop->height);
+  *buffer = hough_plane_resample(crop, canonical_width,
+                                 options->canonical_height, &normalized);
+  return hough_plane_crop(&normalized, cropped);
+}
+
+static void
+recognize_crop_result(const hough_plane *crop,
+                      const hough_options *options,
+                      gboolean rank,
+                      hough_result *result)
+{
+  hough_plane cropped;
+  guchar *buffer, *rotated;
+  double scale;
+
+  memset(result, 0, sizeof(hough_result));
+  result->digit = -1;
+
+  rotated = NULL;
+  if(!canonical_crop(crop, options, &cropped, &buffer))
+    goto out;
+  if(options->deskew)
+    {
+      GArray *edges = hough_plane_edges(&cropped);
+
+      result->skew = estimate_skew(edges, cropped.width, cropped.height);
+      g_array_free(edges, TRUE);
+      /* the dark pixels of the whole crop are turned, as 2 x 2 squares
+       * if it is not taller than the canonical height, and binned into
+       * the canonical size, which smooths the steps the turn leaves on
+       * the stroke edges */
+      if(result->skew != 0)
+        {
+          GArray *points;
+          int factor, width, height, out_width, out_height;
+
+          factor = options->canonical_height > 0 &&
+              cropped.height == crop->height ? DESKEW_FACTOR : 1;
+          points = hough_plane_points_scaled(crop, factor);
+          width = crop->width * factor;
+          height = crop->height * factor;
+          hough_points_rotate(points, -result->skew, &width, &height);
+          out_height = height / factor;
+          if(options->canonical_height > 0)
+            out_height = MIN(out_height, options->canonical_height);
+          out_width = MAX(1, (gint64)width * out_height / height);
+          rotated = hough_plane_from_points(points, width, height,
+                                            out_width, out_height,
+                                            &cropped);
+          g_array_free(points, TRUE);
+        }
+    }
+  /* the thresholds follow the crop height */
+  scale = 1.0;
+  if(options->canonical_height > 0)
+    scale = (double)cropped.height / REFERENCE_HEIGHT;
+
+  if(options->classifier == HOUGH_CLASSIFY_TEMPLATE)
+    result->digit = classify_template(&cropped, &result->confidence);
+  else
+    {
+      hough_plane voted;
+      guchar *thin_buffer;
+
+      /* the prototypes have thick strokes, so only the lines are
+       * looked for on the skeleton */
+      voted = cropped;
+      thin_buffer = NULL;
+      if(options->thin)
+        thin_buffer = thin_crop(&cropped, &voted);
+      recognize_lines(&voted, options, scale, ANGLE_STEP, result);
+      if(options->fine_angle_step > 0 &&
+         options->fine_angle_step < result->angle_step &&
+         result->confidence < options->retry_confidence)
+        {
+          hough_result fine = {0};
+
+          recognize_lines(&voted, options, scale,
+                          options->fine_angle_step, &fine);
+          fine.skew = result->skew;
+          if(fine.digit >= 0 && fine.confidence > result->confidence)
+            {
+              hough_result_clear(result);
+              *result = fine;
+            }
+          else
+            hough_result_clear(&fine);
+        }
+      g_free(thin_buffer);
+    }
+  if(rank)
+    rank_candidates(&cropped, result);
+
+out:
+  g_free(rotated);
+  g_free(buffer);
+}
+
+void
+hough_result_clear(hough_result *result)
+{
+  if(result->lines != NULL)
+    g_array_free(result->lines, TRUE);
+  if(result->arcs != NULL)
+    g_array_free(result->arcs, TRUE);
+  free(result->votes);
+  result->lines = NULL;
+  result->arcs = NULL;
+  result->votes = NULL;
+}
+
+int
+recognize_plane_result(const hough_plane *plane,
+                       const hough_options *options,
+                       hough_result *result)
+{
+  hough_options defaults;
+  hough_plane cleaned, cropped;
+  guchar *buffer;
+
+  if(options == NULL)
+    {
+      hough_options_init(&defaults);
+      options = &defaults;
+    }
+  buffer = clean_plane(plane, options, &cleaned);
+  if(!hough_plane_crop(&cleaned, &cropped))
+    {
+      memset(result, 0, sizeof(hough_result));
+      result->digit = -1;
+      for(int n = 0; n < HOUGH_CANDIDATES; ++n)
+        result->candidates[n].digit = -1;
+      g_free(buffer);
+      return -1;
+    }
+  recognize_crop_result(&cropped, options, TRUE, result);
+  g_free(buffer);
+  return result->digit;
+}
+
+int
+recognize_cropped(const hough_plane *crop,
+                  const hough_options *options,
+                  double *confidence)
+{
+  hough_options defaults;
+  hough_result result;
+  guint64 key;
+  int number;
+  double conf;
+
+  key = 0;
+  if(options == NULL)
+    {
+      hough_options_init(&defaults);
+      options = &defaults;
+    }
+  if(options->cache != NULL)
+    {
+      key = cache_key(crop, options);
+      if(hough_cache_lookup(options->cache, key, &number, &conf))
+        {
+          if(confidence != NULL)
+            *confidence = conf;
+          return number;
+        }
+    }
+
+  recognize_crop_result(crop, options, FALSE, &result);
+  hough_result_clear(&result);
+  if(confidence != NULL)
+    *confidence = result.confidence;
+  if(options->cache != NULL)
+    hough_cache_insert(options->cache, key, result.digit, result.confidence);
+
+  return result.digit;
+}
+
+/* Incremental voting. The accumulator is kept over the whole image
+ * together with the dark mask it was voted from, one bit per pixel,
+ * and the dark pixel counts of every row and column. Each update
+ * compares the new image with the mask a word at a time, within the
+ * changed rectangle if the caller knows it, and only the pixels that
+ * flipped take back or cast their votes. The bounding box comes from
+ * the counts and the segments are walked on the mask, so recognition
+ * does not go over the image again; nothing is cropped or resampled
+ * before voting and the thresholds still follow the digit height. */
+
+struct hough_accum
+{
+  int width;
+  int height;
+  int max_distance;
+  int matr_width;
+  int matr_height;
+  int *matrix;
+  guint64 *mask;
+  int mask_words;
+  int *row_counts;
+  int *column_counts;
+  double sin_table[MAX_ANGLE * 2 / ANGLE_STEP];
+  double cos_table[MAX_ANGLE * 2 / ANGLE_STEP];
+};
+
+hough_accum*
+hough_accum_new(void)
+{
+  hough_accum *accum;
+
+  accum = g_new0(hough_accum, 1);
+  fill_trig_tables(accum->sin_table, accum->cos_table);
+  return accum;
+}
+
+void
+hough_accum_free(hough_accum *accum)
+{
+  if(accum == NULL)
+    return;
+  free(accum->matrix);
+  g_free(accum->mask);
+  g_free(accum->row_counts);
+  g_free(accum->column_counts);
+  g_free(accum);
+}
+
+static void
+accum_reset(hough_accum *accum, int width, int height)
+{
+  int diag;
+
+  free(accum->matrix);
+  g_free(accum->mask);
+  g_free(accum->row_counts);
+  g_free(accum->column_counts);
+  diag = round(sqrt(SQUARE(width - 1) + SQUARE(height - 1)));
+  accum->width = width;
+  accum->height = height;
+  accum->max_distance = MAX_DISTANCE(diag);
+  accum->matr_width = accum->max_distance * 2 + 1;
+  accum->matr_height = (MAX_ANGLE * 2) / ANGLE_STEP;
+  accum->matrix = calloc(accum->matr_width * accum->matr_height,
+                         sizeof (int));
+  accum->mask_words = (width + MASK_BITS - 1) / MASK_BITS;
+  accum->mask = g_new0(guint64, (gsize)accum->mask_words * height);
+  accum->row_counts = g_new0(int, height);
+  accum->column_counts = g_new0(int, width);
+}
+
+static void
+accum_vote(hough_accum *accum, int i, int j, int delta)
+{
+  for(int row = 0; row < accum->matr_height; ++row)
+    {
+      int bin = bin_of(i, j, row, accum->matr_width, accum->max_distance,
+                       accum->sin_table[row], accum->cos_table[row]);
+      if(bin >= 0)
+        accum->matrix[row * accum->matr_width + bin] += delta;
+    }
+  accum->row_counts[i] += delta;
+  accum->column_counts[j] += delta;
+}
+
+int
+hough_accum_update(hough_accum *accum,
+                   const hough_plane *plane)
+{
+  return hough_accum_update_rect(accum, plane, 0, 0,
+                                 plane->width, plane->height);
+}
+
+int
+hough_accum_update_rect(hough_accum *accum,
+                        const hough_plane *plane,
+                        int x, int y,
+                        int width, int height)
+{
+  int changed, left, right, top, bottom;
+
+  /* another image, every dark pixel of it is a change */
+  if(plane->width != accum->width || plane->height != accum->height)
+    {
+      accum_reset(accum, plane->width, plane->height);
+      x = y = 0;
+      width = plane->width;
+      height = plane->height;
+    }
+  left = MAX(x, 0);
+  top = MAX(y, 0);
+  right = MIN((gint64)x + width, plane->width);
+  bottom = MIN((gint64)y + height, plane->height);
+  if(left >= right || top >= bottom)
+    return 0;
+
+  changed = 0;
+  for(int i = top; i < bottom; ++i)
+    {
+      guint64 *mask_row = accum->mask + (gsize)i * accum->mask_words;
+
+      for(int w = left / MASK_BITS; w <= (right - 1) / MASK_BITS; ++w)
+        {
+          int first = w * MASK_BITS;
+          guint64 word, diff;
+
+          word = hough_plane_word(plane, first, i,
+                                  MIN(MASK_BITS, plane->width - first));
+          diff = word ^ mask_row[w];
+          mask_row[w] = word;
+          for(; diff != 0; diff &= diff - 1)
+            {
+              int bit = __builtin_ctzll(diff);
+              accum_vote(accum, i, first + bit, (word >> bit) & 1 ? 1 : -1);
+              changed++;
+            }
+        }
+    }
+  return changed;
+}
+
+/* Bounding box of the dark pixels voted, from the row and column
+ * counts */
+static gboolean
+accum_bbox(const hough_accum *accum,
+           int *x, int *y,
+           int *width, int *height)
+{
+  int top, bottom, left, right;
+
+  for(top = 0; top < accum->height; ++top)
+    if(accum->row_counts[top] > 0)
+      break;
+  if(top == accum->height)
+    return FALSE;
+  for(bottom = accum->height - 1; accum->row_counts[bottom] == 0; --bottom)
+    ;
+  for(left = 0; accum->column_counts[left] == 0; ++left)
+    ;
+  for(right = accum->width - 1; accum->column_counts[right] == 0; --right)
+    ;
+  *x = left;
+  *y = top;
+  *width = right - left + 1;
+  *height = bottom - top + 1;
+  return TRUE;
+}
+
+void
+hough_accum_size(const hough_accum *accum,
+                 int *width,
+                 int *height)
+{
+  *width = accum->width;
+  *height = accum->height;
+}
+
+const int*
+hough_accum_matrix(const hough_accum *accum,
+                   int *matrix_width,
+                   int *matrix_height)
+{
+  *matrix_width = accum->matr_width;
+  *matrix_height = accum->matr_height;
+  return accum->matrix;
+}
+
+int
+recognize_accum(hough_accum *accum,
+                const hough_plane *plane,
+                double *confidence)
+{
+  return recognize_accum_rect(accum, plane, 0, 0,
+                              plane->width, plane->height, confidence);
+}
+
+int
+recognize_accum_rect(hough_accum *accum,
+                     const hough_plane *plane,
+                     int x, int y,
+                     int width, int height,
+                     double *confidence)
+{
+  GHashTable *filtered;
+  GArray *segments;
+  point_grid grid;
+  double scale, lines_conf;
+  int number;
+
+  hough_accum_update_rect(accum, plane, x, y, width, height);
+  if(confidence != NULL)
+    *confidence = 0;
+  if(!accum_bbox(accum, &x, &y, &width, &height))
+    return -1;
+
+  scale = (double)height / REFERENCE_HEIGHT;
+  filtered = filter_accum_matrix_scaled(accum->matrix, accum->matr_width,
+                                        accum->matr_height, scale);
+  point_grid_from_mask(&grid, accum->mask, accum->mask_words,
+                       accum->width, accum->height);
+  segments = grid_segments(&grid, accum->width, accum->height, filtered,
+                           scale);
+  /* the identification rules look at the digit's own frame */
+  for(guint k = 0; k < segments->len; ++k)
+    {
+      hough_segment *segment = &g_array_index(segments, hough_segment, k);
+      segment->x0 -= x;
+      segment->x1 -= x;
+      segment->y0 -= y;
+      segment->y1 -= y;
+    }
+  number = identify_number_by_segments(width, height, filtered, segments);
+  lines_conf = number >= 0 ? lines_confidence(filtered, THRESHOLD * scale) : 0;
+  if(confidence != NULL)
+    *confidence = lines_conf;
+
+  g_array_free(segments, TRUE);
+  g_hash_table_destroy(filtered);
+  return number;
+}
@@ -1,24 +1,289 @@
 #ifndef HOUGHRECOG_H
 #define HOUGHRECOG_H
 
-#include <gtk/gtk.h>
+#include <glib.h>
+#include "hough-plane.h"
+#include "hough-cache.h"
+#include "hough-template.h"
+#include "hough-arcs.h"
 
+#define CANONICAL_HEIGHT 200
+
+typedef enum
+{
+  HOUGH_VOTE_FULL,
+  HOUGH_VOTE_SAMPLED,
+  /* stroke edges vote near their normal only, every degree */
+  HOUGH_VOTE_ORIENTED
+} hough_vote_mode;
+
+typedef enum
+{
+  /* count lines and look where the strokes are */
+  HOUGH_CLASSIFY_LINES,
+  /* nearest of the draw_digit() prototypes */
+  HOUGH_CLASSIFY_TEMPLATE
+} hough_classifier;
+
+typedef struct hough_options
+{
+  hough_vote_mode vote_mode;
+  hough_classifier classifier;
+  /* 0 picks by crop size, 1 votes every pixel at full resolution */
+  int pyramid_factor;
+  /* taller crops are resampled to this height, 0 keeps them as is */
+  int canonical_height;
+  /* random pixel order of HOUGH_VOTE_SAMPLED */
+  guint32 seed;
+  /* results of crops seen before, NULL to always recognize */
+  hough_cache *cache;
+  /* line results less confident than retry_confidence are voted again
+   * every fine_angle_step degrees, 0 never retries */
+  int fine_angle_step;
+  double retry_confidence;
+  /* lines are voted by the skeleton of the strokes */
+  gboolean thin;
+  /* closed bowls found by detect_arcs() decide the digit before the
+   * lines do */
+  gboolean arcs;
+  /* the crop is turned back by estimate_skew() before recognition */
+  gboolean deskew;
+  /* hough_plane_clean() before cropping, 0 and 0 leave the plane as is */
+  int open_radius;
+  int close_radius;
+  /* the accumulator the lines come from is handed back in the result */
+  gboolean keep_votes;
+} hough_options;
+
+/* A line of a filter_accum_matrix() table, which holds a GSList of them
+ * for every angle */
+typedef struct slist_value
+{
+  int points;
+  int dist;
+  int bin;
+} sl_value;
+
+/* Stretch of a detected line actually covered by dark pixels */
+typedef struct hough_segment
+{
+  int angle;
+  int dist;
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+  int length;
+  int points;
+} hough_segment;
+
+#define HOUGH_CANDIDATES 3
+
+typedef struct hough_candidate
+{
+  int digit;
+  /* correlation with the digit's prototype */
+  double score;
+} hough_candidate;
+
+typedef struct hough_result
+{
+  int digit;
+  /* from 0 to 1, how far the peaks of the weakest line clear the
+   * threshold (lead over the runner-up for the template classifier) */
+  double confidence;
+  /* the recognized digit first, then the most similar others */
+  hough_candidate candidates[HOUGH_CANDIDATES];
+  /* hough_segment of the lines found, NULL for the template classifier */
+  GArray *lines;
+  /* hough_arc found if the options ask for them, else NULL */
+  GArray *arcs;
+  /* degrees the digit was turned back by, clockwise */
+  int skew;
+  /* voting step of the lines, finer if the first try was ambiguous */
+  int angle_step;
+  /* size of the crop the lines lie in */
+  int crop_width;
+  int crop_height;
+  /* with keep_votes, the accumulator of the lines, a row of distance
+   * bins for each of the four directions from -90 degrees, and the
+   * scale of its thresholds; NULL for sampled voting */
+  int *votes;
+  int votes_width;
+  int votes_height;
+  double votes_scale;
+} hough_result;
+
+/* Totals of an optional pipeline stage since the start */
+typedef struct hough_stage_stats
+{
+  guint64 calls;
+  guint64 usec;
+  guint64 pixels_in;
+  guint64 pixels_out;
+} hough_stage_stats;
+
+/* Accumulator kept between recognitions of an image being edited */
+typedef struct hough_accum hough_accum;
+
+void
+hough_options_init(hough_options *options);
+
+int*
+accum_matrix_from_plane(const hough_plane *plane,
+                        int *matrix_width,
+                        int *matrix_height);
+
+int*
+accum_matrix_pyramid(const hough_plane *plane,
+                     int factor,
+                     double scale,
+                     int *matrix_width,
+                     int *matrix_height);
+
+/* Votes of every dark pixel every angle_step degrees from -90, one row
+ * per angle */
 int*
-accum_matrix_from_image_with_length(const GdkPixbuf *image,
-                                    int *matrix_width,
-                                    int *matrix_height);
+accum_matrix_angles(const hough_plane *plane,
+                    int angle_step,
+                    int *matrix_width,
+                    int *matrix_height);
+
+/* The same votes counted a few rows at a time, in saturating 16-bit
+ * counters. Much faster at fine steps. */
+guint16*
+accum_matrix_blocked(const hough_plane *plane,
+                     int angle_step,
+                     int *matrix_width,
+                     int *matrix_height);
+
+int*
+accum_matrix_auto(const hough_plane *plane,
+                  const hough_options *options,
+                  double scale,
+                  int *matrix_width,
+                  int *matrix_height);
+
+/* Degrees, up to 10 either way, the straight strokes among the
+ * hough_plane_edges() of a width x height crop are turned clockwise
+ * from the vertical and the horizontal */
+int
+estimate_skew(GArray *edges, int width, int height);
+
+int
+identify_number_by_size(int img_width,
+                        int img_height,
+                        GHashTable *lines);
 
 int
-identify_number(GdkPixbuf *image,
-         GHashTable *lines);
+identify_number_by_segments(int img_width,
+                            int img_height,
+                            GHashTable *lines,
+                            GArray *segments);
+
+/* identify_number_by_segments() deciding by the closed bowls among the
+ * arcs first, if there are any */
+int
+identify_number_by_features(int img_width,
+                            int img_height,
+                            GHashTable *lines,
+                            GArray *segments,
+                            GArray *arcs);
 
 GHashTable*
 filter_accum_matrix(const int *matrix,
                     int width,
                     int height);
 
+GHashTable*
+filter_accum_matrix_scaled(const int *matrix,
+                           int width,
+                           int height,
+                           double scale);
+
+GHashTable*
+lines_from_plane_sampled(const hough_plane *plane,
+                         double scale,
+                         guint32 seed);
+
+GArray*
+extract_segments(const hough_plane *plane,
+                 GHashTable *lines,
+                 double scale);
+
+int
+recognize_plane(const hough_plane *plane,
+                const hough_options *options);
+
+int
+recognize_plane_confidence(const hough_plane *plane,
+                           const hough_options *options,
+                           double *confidence);
+
+/* Everything known about the digit. Does not use the cache. */
+int
+recognize_plane_result(const hough_plane *plane,
+                       const hough_options *options,
+                       hough_result *result);
+
+void
+hough_result_clear(hough_result *result);
+
 void
-highlight (GdkPixbuf *image, GHashTable *table);
+hough_thin_stats(hough_stage_stats *stats);
+
+/* recognize_plane() of a plane already cropped to the digit */
+int
+recognize_cropped(const hough_plane *cropped,
+                  const hough_options *options,
+                  double *confidence);
+
+hough_accum*
+hough_accum_new(void);
+
+void
+hough_accum_free(hough_accum *accum);
+
+/* Brings the votes up to date with the plane, returns how many pixels
+ * changed since the last update */
+int
+hough_accum_update(hough_accum *accum,
+                   const hough_plane *plane);
+
+/* hough_accum_update() when only the pixels of the rectangle x, y,
+ * width, height can have changed since the last update; the rest of the
+ * plane is not read. A plane of another size is read whole. */
+int
+hough_accum_update_rect(hough_accum *accum,
+                        const hough_plane *plane,
+                        int x, int y,
+                        int width, int height);
+
+/* Size of the plane of the last update, 0 x 0 before the first one */
+void
+hough_accum_size(const hough_accum *accum,
+                 int *width,
+                 int *height);
+
+const int*
+hough_accum_matrix(const hough_accum *accum,
+                   int *matrix_width,
+                   int *matrix_height);
+
+/* Updates the accumulator and recognizes the digit from it. The plane
+ * is voted as a whole, without cropping or resampling. */
+int
+recognize_accum(hough_accum *accum,
+                const hough_plane *plane,
+                double *confidence);
+
+/* recognize_accum() with the update of hough_accum_update_rect() */
+int
+recognize_accum_rect(hough_accum *accum,
+                     const hough_plane *plane,
+                     int x, int y,
+                     int width, int height,
+                     double *confidence);
 
 
 #endif // HOUGHRECOG_H
@@ -0,0 +1,223 @@
+#include "hough-template.h"
+#include <math.h>
+#include <string.h>
+
+#define SQUARE(x) ((x) * (x))
+#define PROTO_WIDTH 200
+#define PROTO_HEIGHT 400
+#define PROTO_THICKNESS 25
+#define PROTO_MAX_STROKES 5
+/* below this correlation nothing looks like a digit */
+#define TEMPLATE_MIN_SCORE 0.5
+
+typedef float template_vec __attribute__((vector_size(16)));
+
+typedef struct template_set
+{
+  float signatures[TEMPLATE_DIGITS][TEMPLATE_SIZE]
+  __attribute__((aligned(16)));
+} template_set;
+
+/* Strokes of draw_digit(): 0 is the left or top edge, 1 the middle,
+ * 2 the right or bottom edge */
+static const int strokes[TEMPLATE_DIGITS][PROTO_MAX_STROKES][4] =
+{
+  {{0, 0, 2, 0}, {2, 0, 2, 2}, {2, 2, 0, 2}, {0, 2, 0, 0}, {-1}},
+  {{2, 0, 0, 1}, {2, 0, 2, 2}, {-1}},
+  {{0, 0, 2, 0}, {2, 0, 2, 1}, {2, 1, 0, 2}, {0, 2, 2, 2}, {-1}},
+  {{0, 0, 2, 0}, {2, 0, 0, 1}, {0, 1, 2, 1}, {2, 1, 0, 2}, {-1}},
+  {{0, 0, 0, 1}, {0, 1, 2, 1}, {2, 1, 2, 0}, {2, 1, 2, 2}, {-1}},
+  {{2, 0, 0, 0}, {0, 0, 0, 1}, {0, 1, 2, 1}, {2, 1, 2, 2}, {2, 2, 0, 2}},
+  {{2, 0, 0, 1}, {0, 1, 2, 1}, {2, 1, 2, 2}, {2, 2, 0, 2}, {0, 2, 0, 1}},
+  {{0, 0, 2, 0}, {2, 0, 0, 1}, {0, 1, 0, 2}, {-1}},
+  {{0, 0, 2, 0}, {2, 0, 2, 2}, {2, 2, 0, 2}, {0, 2, 0, 0}, {0, 1, 2, 1}},
+  {{0, 2, 2, 1}, {2, 1, 0, 1}, {0, 1, 0, 0}, {0, 0, 2, 0}, {2, 0, 2, 1}}
+};
+
+static double
+stroke_coord(int unit, int size)
+{
+  return unit == 0 ? 0 : unit == 1 ? (size - 1) / 2 : size - 1;
+}
+
+static double
+distance_to_stroke(double x, double y, const int *stroke)
+{
+  double ax, ay, bx, by, dx, dy, t;
+
+  ax = stroke_coord(stroke[0], PROTO_WIDTH);
+  ay = stroke_coord(stroke[1], PROTO_HEIGHT);
+  bx = stroke_coord(stroke[2], PROTO_WIDTH);
+  by = stroke_coord(stroke[3], PROTO_HEIGHT);
+  dx = bx - ax;
+  dy = by - ay;
+  t = ((x - ax) * dx + (y - ay) * dy) / (SQUARE(dx) + SQUARE(dy));
+  t = CLAMP(t, 0, 1);
+  return sqrt(SQUARE(ax + t * dx - x) + SQUARE(ay + t * dy - y));
+}
+
+static gpointer
+build_prototypes(gpointer data)
+{
+  template_set *set;
+  guchar *pixels;
+  hough_plane plane, cropped;
+
+  set = g_new0(template_set, 1);
+  pixels = g_malloc(PROTO_WIDTH * PROTO_HEIGHT);
+  plane.pixels = pixels;
+  plane.width = PROTO_WIDTH;
+  plane.height = PROTO_HEIGHT;
+  plane.rowstride = PROTO_WIDTH;
+  plane.n_channels = 1;
+  plane.bits = 8;
+  plane.offset = 0;
+
+  for(int digit = 0; digit < TEMPLATE_DIGITS; ++digit)
+    {
+      memset(pixels, 255, PROTO_WIDTH * PROTO_HEIGHT);
+      for(int i = 0; i < PROTO_HEIGHT; ++i)
+        for(int j = 0; j < PROTO_WIDTH; ++j)
+          for(int k = 0; k < PROTO_MAX_STROKES &&
+              strokes[digit][k][0] >= 0; ++k)
+            if(distance_to_stroke(j, i, strokes[digit][k]) <=
+               PROTO_THICKNESS / 2.0)
+              {
+                pixels[i * PROTO_WIDTH + j] = 0;
+                break;
+              }
+      hough_plane_crop(&plane, &cropped);
+      template_signature(&cropped, set->signatures[digit]);
+    }
+
+  g_free(pixels);
+  return set;
+}
+
+static const template_set*
+prototypes(void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  return g_once(&once, build_prototypes, NULL);
+}
+
+gboolean
+template_signature(const hough_plane *cropped,
+                   float *signature)
+{
+  double lo[TEMPLATE_ANGLES], to_bin[TEMPLATE_ANGLES];
+  double sin_table[TEMPLATE_ANGLES], cos_table[TEMPLATE_ANGLES];
+  double mean, norm;
+  int counts[TEMPLATE_SIZE];
+  int w, h, total;
+
+  w = cropped->width - 1;
+  h = cropped->height - 1;
+  for(int a = 0; a < TEMPLATE_ANGLES; ++a)
+    {
+      double phi = (a * 45 - 90) * M_PI / 180;
+      double c[4], hi;
+
+      sin_table[a] = sin(phi);
+      cos_table[a] = cos(phi);
+      /* distances of the crop corners bound the accumulator row */
+      c[0] = 0;
+      c[1] = w * cos_table[a];
+      c[2] = h * sin_table[a];
+      c[3] = c[1] + c[2];
+      lo[a] = MIN(MIN(c[0], c[1]), MIN(c[2], c[3]));
+      hi = MAX(MAX(c[0], c[1]), MAX(c[2], c[3]));
+      to_bin[a] = TEMPLATE_BINS / (hi - lo[a] + 1);
+    }
+
+  memset(counts, 0, sizeof(counts));
+  total = 0;
+  for(int i = 0; i < cropped->height; ++i)
+    for(int j = 0; j < cropped->width; ++j)
+      {
+        if(!hough_plane_is_dark(cropped, j, i))
+          continue;
+        total++;
+        for(int a = 0; a < TEMPLATE_ANGLES; ++a)
+          {
+            double distance = i * sin_table[a] + j * cos_table[a];
+            counts[a * TEMPLATE_BINS +
+                   (int)((distance - lo[a]) * to_bin[a])]++;
+          }
+      }
+  if(total == 0)
+    {
+      memset(signature, 0, TEMPLATE_SIZE * sizeof(float));
+      return FALSE;
+    }
+
+  /* every angle holds total votes, so the mean is known up front */
+  mean = (double)total / TEMPLATE_BINS;
+  norm = 0;
+  for(int k = 0; k < TEMPLATE_SIZE; ++k)
+    norm += SQUARE(counts[k] - mean);
+  norm = norm > 0 ? 1 / sqrt(norm) : 0;
+  for(int k = 0; k < TEMPLATE_SIZE; ++k)
+    signature[k] = (counts[k] - mean) * norm;
+  return TRUE;
+}
+
+/* Both signatures 16 byte aligned */
+static float
+dot(const float *a, const float *b)
+{
+  const template_vec *va = (const template_vec*)a;
+  const template_vec *vb = (const template_vec*)b;
+  template_vec sum = {0, 0, 0, 0};
+
+  for(int k = 0; k < TEMPLATE_SIZE / 4; ++k)
+    sum += va[k] * vb[k];
+  return sum[0] + sum[1] + sum[2] + sum[3];
+}
+
+void
+template_scores(const hough_plane *cropped,
+                double *scores)
+{
+  const template_set *set;
+  float signature[TEMPLATE_SIZE] __attribute__((aligned(16)));
+
+  set = prototypes();
+  template_signature(cropped, signature);
+  for(int digit = 0; digit < TEMPLATE_DIGITS; ++digit)
+    scores[digit] = dot(signature, set->signatures[digit]);
+}
+
+int
+classify_template(const hough_plane *cropped,
+                  double *confidence)
+{
+  double scores[TEMPLATE_DIGITS];
+  int best, second;
+
+  template_scores(cropped, scores);
+  best = 0;
+  second = 1;
+  for(int digit = 1; digit < TEMPLATE_DIGITS; ++digit)
+    if(scores[digit] > scores[best])
+      {
+        second = best;
+        best = digit;
+      }
+    else if(digit != second && scores[digit] > scores[second])
+      second = digit;
+
+  if(scores[best] < TEMPLATE_MIN_SCORE)
+    {
+      if(confidence != NULL)
+        *confidence = 0;
+      return -1;
+    }
+  /* how much of the distance left to a perfect match separates the
+   * winner from the runner-up */
+  if(confidence != NULL)
+    *confidence = (scores[best] - scores[second]) /
+        MAX(1 - scores[second], 1e-6);
+  return best;
+}
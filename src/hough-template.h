@@ -0,0 +1,32 @@
+#ifndef HOUGHTEMPLATE_H
+#define HOUGHTEMPLATE_H
+
+#include <glib.h>
+#include "hough-plane.h"
+
+/* Nearest prototype classifier. A signature is the line accumulator of
+ * the crop shrunk to TEMPLATE_BINS distance bins per angle, each bin
+ * spanning the same share of the crop, so digits of any size compare
+ * with the ten prototypes drawn like draw_digit() does. */
+
+#define TEMPLATE_BINS 16
+#define TEMPLATE_ANGLES 4
+#define TEMPLATE_SIZE (TEMPLATE_BINS * TEMPLATE_ANGLES)
+#define TEMPLATE_DIGITS 10
+
+/* Centered and normalized signature of a cropped digit, FALSE if it has
+ * no dark pixels */
+gboolean
+template_signature(const hough_plane *cropped,
+                   float *signature);
+
+/* Correlation of the crop with each prototype, from -1 to 1 */
+void
+template_scores(const hough_plane *cropped,
+                double *scores);
+
+int
+classify_template(const hough_plane *cropped,
+                  double *confidence);
+
+#endif // HOUGHTEMPLATE_H
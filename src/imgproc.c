@@ -1,11 +1,16 @@
 #include "imgproc.h"
 #include <stdlib.h>
+#include <string.h>
 #include <opencv2/imgproc/imgproc_c.h>
-#include <time.h>
+#include "hough-bands.h"
+#include "hough-pixbuf.h"
 
 #define THICKNESS 25
 #define STEP_RATIO 40
 #define BREACH_RADIUS 200
+/* rows of a band of the _parallel() functions, and columns */
+#define BAND_ROWS 64
+#define BAND_COLUMNS 16
 
 static IplImage *
 pixbuf2ipl(const GdkPixbuf *image)
@@ -524,8 +529,6 @@ noise (const GdkPixbuf *image)
   res_pix = gdk_pixbuf_get_pixels(res);
   res_stride = gdk_pixbuf_get_rowstride(res);
 
-  srand(time(NULL));
-
   int width_step = width / STEP_RATIO;
   int height_step = height / STEP_RATIO;
 
@@ -585,8 +588,6 @@ breach (const GdkPixbuf *image)
   res_pix = gdk_pixbuf_get_pixels(res);
   res_stride = gdk_pixbuf_get_rowstride(res);
 
-  srand(time(NULL));
-
   for (int i = 0; i < height; ++i)
     for (int j = 0; j < width; ++j)
       {
@@ -634,6 +635,271 @@ breach (const GdkPixbuf *image)
   return res;
 }
 
+/* Row band versions of the above on the pool of hough-bands.c. Each
+ * band writes rows of its own, or columns for the last step of
+ * breach_parallel(). */
+
+typedef struct pixbuf_bands
+{
+  const guchar *pixels;
+  guchar *res_pix;
+  int width, height;
+  int channels, stride;
+  int res_channels, res_stride;
+  /* toBinary_parallel() */
+  hough_plane binary;
+  /* noise_parallel(): blocks to invert, row by row */
+  const guchar *blocks;
+  int width_step, height_step;
+  int n_block_columns;
+  /* breach_parallel(): seed of band 0, and the centres of the squares
+   * to clear, then the pixels across from one */
+  guint32 seed;
+  guchar *centres;
+} pixbuf_bands;
+
+static GdkPixbuf*
+new_result(const GdkPixbuf *image, gboolean has_alpha, pixbuf_bands *job)
+{
+  GdkPixbuf *res;
+
+  memset(job, 0, sizeof (pixbuf_bands));
+  job->pixels = gdk_pixbuf_get_pixels(image);
+  job->width = gdk_pixbuf_get_width(image);
+  job->height = gdk_pixbuf_get_height(image);
+  job->channels = gdk_pixbuf_get_n_channels(image);
+  job->stride = gdk_pixbuf_get_rowstride(image);
+
+  res = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, CHANNEL_DEPTH,
+                       job->width, job->height);
+  job->res_pix = gdk_pixbuf_get_pixels(res);
+  job->res_channels = gdk_pixbuf_get_n_channels(res);
+  job->res_stride = gdk_pixbuf_get_rowstride(res);
+  return res;
+}
+
+/* Inverted the way noise() and breach() invert, green from blue */
+static inline void
+copy_pixel(const guchar *src, guchar *dst, int channels, gboolean invert)
+{
+  memcpy(dst, src, channels);
+  if(invert)
+    {
+      dst[0] = 255 - src[0];
+      dst[1] = 255 - src[2];
+      dst[2] = 255 - src[2];
+    }
+}
+
+static void
+binary_band(int band, int first, int last, gpointer data)
+{
+  pixbuf_bands *job = data;
+
+  for(int i = first; i < last; ++i)
+    {
+      guchar *dst = job->res_pix + (gsize)i * job->res_stride;
+
+      for(int j = 0; j < job->width; ++j)
+        memset(dst + j * N_CHANNELS_RGB,
+               hough_plane_is_dark(&job->binary, j, i) ? 0 : 255,
+               N_CHANNELS_RGB);
+    }
+}
+
+GdkPixbuf*
+toBinary_parallel(const GdkPixbuf *image)
+{
+  pixbuf_bands job;
+  hough_plane view;
+  GdkPixbuf *res;
+  guchar *buffer;
+
+  res = new_result(image, FALSE, &job);
+  hough_plane_from_pixbuf(image, &view);
+  buffer = hough_plane_threshold_parallel(&view, PLANE_THRESHOLD_FIXED,
+                                          &job.binary);
+  hough_bands_run(job.height, hough_bands_count(job.height, BAND_ROWS),
+                  binary_band, &job);
+  g_free(buffer);
+  return res;
+}
+
+GdkPixbuf*
+cropImage_parallel(const GdkPixbuf *image)
+{
+  hough_plane view;
+  int x, y, width, height;
+
+  hough_plane_from_pixbuf(image, &view);
+  if(!hough_plane_bbox_parallel(&view, &x, &y, &width, &height))
+    {
+      x = y = 0;
+      width = view.width;
+      height = view.height;
+    }
+  return get_image_from_ROI(image, x, y, width, height);
+}
+
+static void
+noise_band(int band, int first, int last, gpointer data)
+{
+  pixbuf_bands *job = data;
+
+  for(int i = first; i < last; ++i)
+    {
+      const guchar *src = job->pixels + (gsize)i * job->stride;
+      guchar *dst = job->res_pix + (gsize)i * job->res_stride;
+      const guchar *inverted = job->blocks +
+          i / job->height_step * job->n_block_columns;
+
+      for(int b = 0; b < job->n_block_columns; ++b)
+        {
+          int end = MIN((b + 1) * job->width_step, job->width);
+
+          for(int j = b * job->width_step; j < end; ++j)
+            copy_pixel(src + j * job->channels, dst + j * job->res_channels,
+                       job->res_channels, inverted[b]);
+        }
+    }
+}
+
+GdkPixbuf*
+noise_parallel(const GdkPixbuf *image)
+{
+  pixbuf_bands job;
+  GdkPixbuf *res;
+  guchar *blocks;
+  int n_blocks;
+
+  res = new_result(image, gdk_pixbuf_get_has_alpha(image), &job);
+  job.width_step = MAX(job.width / STEP_RATIO, 1);
+  job.height_step = MAX(job.height / STEP_RATIO, 1);
+  job.n_block_columns = (job.width + job.width_step - 1) / job.width_step;
+  n_blocks = job.n_block_columns *
+      ((job.height + job.height_step - 1) / job.height_step);
+
+  /* drawn in the order noise() draws them */
+  blocks = g_malloc(n_blocks);
+  for(int k = 0; k < n_blocks; ++k)
+    blocks[k] = rand() % 18 == 0;
+  job.blocks = blocks;
+  hough_bands_run(job.height, hough_bands_count(job.height, BAND_ROWS),
+                  noise_band, &job);
+  g_free(blocks);
+  return res;
+}
+
+/* Light pixels copied or inverted, dark ones copied and marked as the
+ * centre of a breach now and then. A band draws from a generator of its
+ * own seeded by its number. */
+static void
+breach_band(int band, int first, int last, gpointer data)
+{
+  pixbuf_bands *job = data;
+  GRand *rand;
+
+  rand = g_rand_new_with_seed(job->seed + band);
+  for(int i = first; i < last; ++i)
+    {
+      const guchar *src = job->pixels + (gsize)i * job->stride;
+      guchar *dst = job->res_pix + (gsize)i * job->res_stride;
+      guchar *centres = job->centres + (gsize)i * job->width;
+
+      for(int j = 0; j < job->width; ++j)
+        {
+          const guchar *s = src + j * job->channels;
+          gboolean dark = s[0] == 0;
+
+          centres[j] = dark && g_rand_int_range(rand, 0, 50) == 0;
+          copy_pixel(s, dst + j * job->res_channels, job->res_channels,
+                     !dark && g_rand_int_range(rand, 0, 30) == 0);
+        }
+    }
+  g_rand_free(rand);
+}
+
+/* Marks the pixels less than BREACH_RADIUS columns from a centre, with
+ * a count of the centres in a window sliding along the row */
+static void
+spread_rows_band(int band, int first, int last, gpointer data)
+{
+  pixbuf_bands *job = data;
+  guchar *copy;
+
+  copy = g_malloc(job->width);
+  for(int i = first; i < last; ++i)
+    {
+      guchar *row = job->centres + (gsize)i * job->width;
+      int count = 0;
+
+      memcpy(copy, row, job->width);
+      for(int j = 0; j <= BREACH_RADIUS && j < job->width; ++j)
+        count += copy[j];
+      for(int j = 0; j < job->width; ++j)
+        {
+          row[j] = count > 0;
+          if(j + BREACH_RADIUS + 1 < job->width)
+            count += copy[j + BREACH_RADIUS + 1];
+          if(j - BREACH_RADIUS >= 0)
+            count -= copy[j - BREACH_RADIUS];
+        }
+    }
+  g_free(copy);
+}
+
+/* The same down the columns, clearing the dark pixels in reach */
+static void
+spread_columns_band(int band, int first, int last, gpointer data)
+{
+  pixbuf_bands *job = data;
+  int *counts;
+
+  counts = g_new0(int, last - first);
+  for(int i = 0; i <= BREACH_RADIUS && i < job->height; ++i)
+    for(int j = first; j < last; ++j)
+      counts[j - first] += job->centres[(gsize)i * job->width + j];
+  for(int i = 0; i < job->height; ++i)
+    {
+      const guchar *src = job->pixels + (gsize)i * job->stride;
+      guchar *dst = job->res_pix + (gsize)i * job->res_stride;
+      int enters = i + BREACH_RADIUS + 1;
+      int leaves = i - BREACH_RADIUS;
+
+      for(int j = first; j < last; ++j)
+        if(counts[j - first] > 0 && src[j * job->channels] == 0)
+          memset(dst + j * job->res_channels, 255, N_CHANNELS_RGB);
+      if(enters < job->height)
+        for(int j = first; j < last; ++j)
+          counts[j - first] += job->centres[(gsize)enters * job->width + j];
+      if(leaves >= 0)
+        for(int j = first; j < last; ++j)
+          counts[j - first] -= job->centres[(gsize)leaves * job->width + j];
+    }
+  g_free(counts);
+}
+
+GdkPixbuf*
+breach_parallel(const GdkPixbuf *image)
+{
+  pixbuf_bands job;
+  GdkPixbuf *res;
+
+  res = new_result(image, gdk_pixbuf_get_has_alpha(image), &job);
+  job.seed = rand();
+  job.centres = g_malloc((gsize)job.width * job.height);
+
+  /* a band count of its own, the same on any machine */
+  hough_bands_run(job.height, (job.height + BAND_ROWS - 1) / BAND_ROWS,
+                  breach_band, &job);
+  hough_bands_run(job.height, hough_bands_count(job.height, BAND_ROWS),
+                  spread_rows_band, &job);
+  hough_bands_run(job.width, hough_bands_count(job.width, BAND_COLUMNS),
+                  spread_columns_band, &job);
+  g_free(job.centres);
+  return res;
+}
+
 #undef DRAW_ZERO
 #undef DRAW_ONE
 #undef DRAW_TWO
@@ -18,9 +18,26 @@ GdkPixbuf*
 canny_detector(const GdkPixbuf *image);
 GdkPixbuf*
 draw_digit(int digit);
+/* noise() and breach() draw from rand(), seed it with srand() */
 GdkPixbuf*
 noise (const GdkPixbuf *image);
 GdkPixbuf*
 breach (const GdkPixbuf *image);
 
+/* The above split into row bands over all processors for large scans.
+ * toBinary_parallel() gives what toBinary() gives, cropImage_parallel()
+ * crops to the pixels darker than PLANE_DARK_LEVEL, which on a binary
+ * image are the black ones cropImage() looks for. noise_parallel()
+ * gives what noise() gives for the same seed; breach_parallel()
+ * draws a generator per band from rand() and clears squares centred on
+ * the dark pixels it picks. */
+GdkPixbuf*
+toBinary_parallel(const GdkPixbuf *image);
+GdkPixbuf*
+cropImage_parallel(const GdkPixbuf *image);
+GdkPixbuf*
+noise_parallel(const GdkPixbuf *image);
+GdkPixbuf*
+breach_parallel(const GdkPixbuf *image);
+
 #endif // IMGPROC_H
@@ -1,6 +1,6 @@
 #include "interface.h"
 #include "imgproc.h"
-#include "hough-recog.h"
+#include "hough-pixbuf.h"
 #include <math.h>
 #include <stdio.h>
 #include <cairo.h>
@@ -12,6 +12,8 @@
 static int mouse_flag = MOUSE_UP;
 static int roi_is_set = 0;
 static GdkPixbuf *clear_img = NULL;
+/* votes of the image last recognized, edits only recount what changed */
+static hough_accum *accum = NULL;
 struct point
 {
   int x,y;
@@ -21,6 +23,9 @@ struct rect
   int x, y, width, height;
 } roi;
 struct rect img_size;
+/* part of the image edited since it was last recognized */
+static struct rect changed;
+static int changed_all = 1;
 
 #define INIT_RECT(rec, imx, imy, imwidth, imheight)\
 {\
@@ -36,6 +41,24 @@ struct rect img_size;
 
 static GtkBuilder *builder;
 
+static void
+mark_changed(const struct rect *area)
+{
+  int right, bottom;
+
+  if(changed.width <= 0 || changed.height <= 0)
+    {
+      changed = *area;
+      return;
+    }
+  right = MAX(changed.x + changed.width, area->x + area->width);
+  bottom = MAX(changed.y + changed.height, area->y + area->height);
+  changed.x = MIN(changed.x, area->x);
+  changed.y = MIN(changed.y, area->y);
+  changed.width = right - changed.x;
+  changed.height = bottom - changed.y;
+}
+
 static void
 on_open_image(GtkWidget *button, gpointer data)
 {
@@ -68,6 +91,7 @@ on_open_image(GtkWidget *button, gpointer data)
         gchar *fname = gtk_file_chooser_get_filename(
               GTK_FILE_CHOOSER(fdialog));
         gtk_image_set_from_file(image, fname);
+        changed_all = 1;
         gtk_widget_set_sensitive(recog_button, TRUE);
         break;
       }
@@ -102,25 +126,17 @@ draw_and_save_10_digits(const gchar* path)
 static int
 classify(const GdkPixbuf *image)
 {
-  int *matrix, width, height;
-  GHashTable *filtered;
   int number;
-  GdkPixbuf *binary, *croped;
-
-  binary = toBinary(image);
-  croped = cropImage(binary);
-
-  matrix = accum_matrix_from_image_with_length(croped,
-                                               &width,
-                                               &height);
-  filtered = filter_accum_matrix(matrix, width, height);
-  number = identify_number(croped, filtered);
-
-  g_object_unref(binary);
-  g_object_unref(croped);
-  g_hash_table_destroy(filtered);
-  free(matrix);
 
+  if(accum == NULL)
+    accum = hough_accum_new();
+  if(changed_all)
+    number = classify_pixbuf(image, accum);
+  else
+    number = classify_pixbuf_rect(image, accum, changed.x, changed.y,
+                                  changed.width, changed.height);
+  changed_all = 0;
+  INIT_RECT(changed, 0, 0, 0, 0);
   return number;
 }
 
@@ -216,9 +232,10 @@ put_noise (GSimpleAction *action,
 
   image = GTK_IMAGE(data);
   pbuf = gtk_image_get_pixbuf(image);
-  modified = noise(pbuf);
-//  modified = breach(pbuf);
+  modified = noise_parallel(pbuf);
+//  modified = breach_parallel(pbuf);
   gtk_image_set_from_pixbuf(image, modified);
+  changed_all = 1;
 }
 
 static GdkPixbuf *draw_rect(GdkPixbuf *image,
@@ -258,6 +275,7 @@ static void redraw(GtkImage *image,
   src_img = gtk_image_get_pixbuf(image);
   res_img = draw_rect(src_img, roi);
   gtk_image_set_from_pixbuf(image, res_img);
+  mark_changed(roi);
 
   g_object_unref(res_img);
 }
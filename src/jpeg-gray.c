@@ -0,0 +1,136 @@
+#include "jpeg-gray.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+
+#define MAX_DENOM 8
+
+typedef struct jpeg_failure
+{
+  struct jpeg_error_mgr manager;
+  jmp_buf jump;
+} jpeg_failure;
+
+static void
+jump_out(j_common_ptr cinfo)
+{
+  longjmp(((jpeg_failure*)cinfo->err)->jump, 1);
+}
+
+/* broken files are reported by whoever decodes them next */
+static void
+keep_quiet(j_common_ptr cinfo)
+{
+}
+
+/* Luminance of the JPEG at 1/denom into *pixels */
+static gboolean
+decode_scaled(const guchar *data, gsize size, int denom,
+              guchar **pixels, gsize *pixels_size, hough_plane *gray)
+{
+  struct jpeg_decompress_struct cinfo;
+  jpeg_failure failure;
+  gsize need;
+
+  cinfo.err = jpeg_std_error(&failure.manager);
+  failure.manager.error_exit = jump_out;
+  failure.manager.output_message = keep_quiet;
+  jpeg_create_decompress(&cinfo);
+  if(setjmp(failure.jump))
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return FALSE;
+    }
+  jpeg_mem_src(&cinfo, (unsigned char*)data, size);
+  jpeg_read_header(&cinfo, TRUE);
+  /* of YCbCr only the Y component is decoded, CMYK has no gray */
+  if(cinfo.jpeg_color_space != JCS_GRAYSCALE &&
+     cinfo.jpeg_color_space != JCS_YCbCr)
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return FALSE;
+    }
+  cinfo.out_color_space = JCS_GRAYSCALE;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  need = (gsize)cinfo.output_width * cinfo.output_height;
+  if(*pixels_size < need)
+    {
+      g_free(*pixels);
+      *pixels = g_malloc(need);
+      *pixels_size = need;
+    }
+  while(cinfo.output_scanline < cinfo.output_height)
+    {
+      JSAMPROW row = *pixels + (gsize)cinfo.output_scanline *
+          cinfo.output_width;
+
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+  gray->pixels = *pixels;
+  gray->width = cinfo.output_width;
+  gray->height = cinfo.output_height;
+  gray->rowstride = cinfo.output_width;
+  gray->n_channels = 1;
+  gray->bits = 8;
+  gray->offset = 0;
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return TRUE;
+}
+
+gboolean
+jpeg_decode_gray(const guchar *data,
+                 gsize size,
+                 int digit_height,
+                 hough_threshold threshold,
+                 int *scale,
+                 guchar **pixels,
+                 gsize *pixels_size,
+                 hough_plane *gray)
+{
+  int denom;
+
+  if(size < 2 || data[0] != 0xff || data[1] != 0xd8)
+    return FALSE;
+  denom = 1;
+  if(digit_height > 0)
+    while(denom < MAX_DENOM && denom < *scale)
+      denom *= 2;
+
+  for(;;)
+    {
+      hough_plane binary;
+      guchar *buffer;
+      int x, y, width, height, fit;
+      gboolean found;
+
+      if(!decode_scaled(data, size, denom, pixels, pixels_size, gray))
+        return FALSE;
+      if(digit_height <= 0)
+        break;
+      buffer = hough_plane_threshold(gray, threshold, &binary);
+      found = hough_plane_bbox(&binary, &x, &y, &width, &height);
+      g_free(buffer);
+
+      /* strokes lost to the reduction leave nothing or a smaller box,
+       * both of which only keep more pixels */
+      fit = found ? denom : 1;
+      while(fit > 1 && height * denom / fit < digit_height)
+        fit /= 2;
+      if(fit == denom)
+        {
+          /* twice as tall as needed, the next one may do with half */
+          if(found && height >= 2 * digit_height && denom < MAX_DENOM)
+            denom *= 2;
+          break;
+        }
+      denom = fit;
+    }
+  *scale = denom;
+  return TRUE;
+}
@@ -0,0 +1,24 @@
+#ifndef JPEG_GRAY_H
+#define JPEG_GRAY_H
+
+#include "hough-plane.h"
+
+/* Decodes a JPEG in memory straight to 8-bit gray, reduced by a DCT
+ * scale of 1/2, 1/4 or 1/8 as long as the dark content, found with the
+ * threshold, stays digit_height rows tall; 0 decodes at full size.
+ * *scale is the denominator tried first and comes back as the one to
+ * try on the next image, so a run of similar scans is decoded once
+ * each. The pixels go to *pixels, grown to *pixels_size bytes when too
+ * small. FALSE if the data is not a JPEG libjpeg can make gray, to be
+ * decoded some other way. */
+gboolean
+jpeg_decode_gray(const guchar *data,
+                 gsize size,
+                 int digit_height,
+                 hough_threshold threshold,
+                 int *scale,
+                 guchar **pixels,
+                 gsize *pixels_size,
+                 hough_plane *gray);
+
+#endif // JPEG_GRAY_H
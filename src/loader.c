@@ -0,0 +1,324 @@
+#include "loader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "hough-pixbuf.h"
+#ifdef HAVE_JPEG
+#include "jpeg-gray.h"
+#endif
+
+#define READ_CHUNK (64 * 1024)
+
+typedef struct load_slot
+{
+  loaded_image image;
+  /* file contents and gray pixels, grown to the largest image yet */
+  guchar *data;
+  gsize data_size;
+  guchar *gray;
+  gsize gray_size;
+} load_slot;
+
+/* Bounded queue for any number of producers and consumers: every cell
+ * has a sequence number telling whose turn it is, so a push or a pop is
+ * one compare and swap of the head or the tail. The queues hold as many
+ * cells as there are slots, so pushing never finds them full; popping
+ * an empty one sleeps on the condition until a push. */
+typedef struct slot_queue
+{
+  gint head;
+  gint tail;
+  guint mask;
+  gint *seq;
+  load_slot **cells;
+  gint n_waiting;
+  GMutex lock;
+  GCond cond;
+} slot_queue;
+
+struct image_loader
+{
+  gchar **paths;
+  int n_paths;
+  /* next path for a decoder and for image_loader_next() */
+  gint next_path;
+  gint next_image;
+  load_slot *slots;
+  int n_slots;
+  slot_queue free_slots;
+  slot_queue ready;
+  GThread **decoders;
+  int n_decoders;
+  int digit_height;
+  hough_threshold threshold;
+};
+
+static void
+queue_init(slot_queue *q, int n_slots)
+{
+  guint n_cells = 1;
+
+  while(n_cells < (guint)n_slots)
+    n_cells <<= 1;
+  q->head = 0;
+  q->tail = 0;
+  q->mask = n_cells - 1;
+  q->seq = g_new(gint, n_cells);
+  q->cells = g_new0(load_slot*, n_cells);
+  for(guint k = 0; k < n_cells; ++k)
+    q->seq[k] = k;
+  q->n_waiting = 0;
+  g_mutex_init(&q->lock);
+  g_cond_init(&q->cond);
+}
+
+static void
+queue_clear(slot_queue *q)
+{
+  g_free(q->seq);
+  g_free(q->cells);
+  g_mutex_clear(&q->lock);
+  g_cond_clear(&q->cond);
+}
+
+static void
+queue_push(slot_queue *q, load_slot *slot)
+{
+  for(;;)
+    {
+      guint pos = g_atomic_int_get(&q->head);
+      guint cell = pos & q->mask;
+      gint turn = (gint)((guint)g_atomic_int_get(&q->seq[cell]) - pos);
+
+      /* the cell is still being emptied, the consumer is about to be
+       * done with it */
+      if(turn != 0)
+        continue;
+      if(g_atomic_int_compare_and_exchange(&q->head, pos, pos + 1))
+        {
+          q->cells[cell] = slot;
+          g_atomic_int_set(&q->seq[cell], pos + 1);
+          break;
+        }
+    }
+  if(g_atomic_int_get(&q->n_waiting) > 0)
+    {
+      g_mutex_lock(&q->lock);
+      g_cond_signal(&q->cond);
+      g_mutex_unlock(&q->lock);
+    }
+}
+
+static load_slot*
+queue_try_pop(slot_queue *q)
+{
+  for(;;)
+    {
+      guint pos = g_atomic_int_get(&q->tail);
+      guint cell = pos & q->mask;
+      gint turn = (gint)((guint)g_atomic_int_get(&q->seq[cell]) - (pos + 1));
+      load_slot *slot;
+
+      if(turn < 0)
+        return NULL;
+      if(turn > 0 || !g_atomic_int_compare_and_exchange(&q->tail, pos,
+                                                        pos + 1))
+        continue;
+      slot = q->cells[cell];
+      g_atomic_int_set(&q->seq[cell], pos + q->mask + 1);
+      return slot;
+    }
+}
+
+static load_slot*
+queue_pop(slot_queue *q)
+{
+  load_slot *slot;
+
+  slot = queue_try_pop(q);
+  if(slot != NULL)
+    return slot;
+
+  /* a push after the waiting count is up signals under the lock, which
+   * is held from the last look until the wait */
+  g_mutex_lock(&q->lock);
+  g_atomic_int_inc(&q->n_waiting);
+  while((slot = queue_try_pop(q)) == NULL)
+    g_cond_wait(&q->cond, &q->lock);
+  g_atomic_int_add(&q->n_waiting, -1);
+  g_mutex_unlock(&q->lock);
+  return slot;
+}
+
+static gboolean
+read_file(load_slot *slot, const gchar *path, gsize *size, GError **error)
+{
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    {
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                  "%s: %s", path, g_strerror(errno));
+      return FALSE;
+    }
+  *size = 0;
+  for(;;)
+    {
+      ssize_t n;
+
+      if(slot->data_size - *size < READ_CHUNK)
+        {
+          slot->data_size = MAX(slot->data_size * 2, *size + READ_CHUNK);
+          slot->data = g_realloc(slot->data, slot->data_size);
+        }
+      n = read(fd, slot->data + *size, slot->data_size - *size);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n < 0)
+        {
+          g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                      "%s: %s", path, g_strerror(errno));
+          close(fd);
+          return FALSE;
+        }
+      if(n == 0)
+        break;
+      *size += n;
+    }
+  close(fd);
+  return TRUE;
+}
+
+/* scale is the JPEG reduction of the decoding thread, see
+ * jpeg_decode_gray() */
+static void
+decode_file(const image_loader *loader, load_slot *slot, const gchar *path,
+            int *scale)
+{
+  GdkPixbufLoader *decoder;
+  hough_plane view;
+  gsize size, gray_size;
+  gboolean ok;
+
+  if(!read_file(slot, path, &size, &slot->image.error))
+    return;
+#ifdef HAVE_JPEG
+  if(jpeg_decode_gray(slot->data, size, loader->digit_height,
+                      loader->threshold, scale, &slot->gray,
+                      &slot->gray_size, &slot->image.plane))
+    return;
+#endif
+
+  /* the loader makes RGB whatever the file, it is made gray at once */
+  decoder = gdk_pixbuf_loader_new();
+  ok = gdk_pixbuf_loader_write(decoder, slot->data, size, &slot->image.error);
+  ok = gdk_pixbuf_loader_close(decoder, ok ? &slot->image.error : NULL) && ok;
+  if(!ok)
+    {
+      g_prefix_error(&slot->image.error, "%s: ", path);
+      g_object_unref(decoder);
+      return;
+    }
+  hough_plane_from_pixbuf(gdk_pixbuf_loader_get_pixbuf(decoder), &view);
+  gray_size = (gsize)view.width * view.height;
+  if(slot->gray_size < gray_size)
+    {
+      g_free(slot->gray);
+      slot->gray = g_malloc(gray_size);
+      slot->gray_size = gray_size;
+    }
+  hough_plane_gray_into(&view, slot->gray, &slot->image.plane);
+  g_object_unref(decoder);
+}
+
+static gpointer
+decode_files(gpointer data)
+{
+  image_loader *loader = data;
+  /* the smallest decode first, it grows as far as the digits need */
+  int scale = 8;
+
+  for(;;)
+    {
+      int index = g_atomic_int_add(&loader->next_path, 1);
+      load_slot *slot;
+
+      if(index >= loader->n_paths)
+        break;
+      slot = queue_pop(&loader->free_slots);
+      slot->image.index = index;
+      slot->image.path = loader->paths[index];
+      slot->image.error = NULL;
+      memset(&slot->image.plane, 0, sizeof(hough_plane));
+      decode_file(loader, slot, loader->paths[index], &scale);
+      queue_push(&loader->ready, slot);
+    }
+  return NULL;
+}
+
+image_loader*
+image_loader_new(gchar **paths,
+                 int n_paths,
+                 int n_decoders,
+                 int n_slots,
+                 int digit_height,
+                 hough_threshold threshold)
+{
+  image_loader *loader;
+
+  loader = g_new0(image_loader, 1);
+  loader->paths = paths;
+  loader->n_paths = n_paths;
+  loader->digit_height = digit_height;
+  loader->threshold = threshold;
+  loader->n_slots = MAX(1, n_slots);
+  loader->slots = g_new0(load_slot, loader->n_slots);
+  queue_init(&loader->free_slots, loader->n_slots);
+  queue_init(&loader->ready, loader->n_slots);
+  for(int k = 0; k < loader->n_slots; ++k)
+    queue_push(&loader->free_slots, &loader->slots[k]);
+
+  loader->n_decoders = MAX(1, n_decoders);
+  loader->decoders = g_new(GThread*, loader->n_decoders);
+  for(int k = 0; k < loader->n_decoders; ++k)
+    loader->decoders[k] = g_thread_new("decoder", decode_files, loader);
+  return loader;
+}
+
+loaded_image*
+image_loader_next(image_loader *loader)
+{
+  /* every path claimed here is decoded sooner or later */
+  if(g_atomic_int_add(&loader->next_image, 1) >= loader->n_paths)
+    return NULL;
+  return &queue_pop(&loader->ready)->image;
+}
+
+void
+image_loader_release(image_loader *loader,
+                     loaded_image *image)
+{
+  load_slot *slot = (load_slot*)image;
+
+  g_clear_error(&slot->image.error);
+  queue_push(&loader->free_slots, slot);
+}
+
+void
+image_loader_free(image_loader *loader)
+{
+  for(int k = 0; k < loader->n_decoders; ++k)
+    g_thread_join(loader->decoders[k]);
+  for(int k = 0; k < loader->n_slots; ++k)
+    {
+      g_free(loader->slots[k].data);
+      g_free(loader->slots[k].gray);
+    }
+  queue_clear(&loader->free_slots);
+  queue_clear(&loader->ready);
+  g_free(loader->slots);
+  g_free(loader->decoders);
+  g_free(loader);
+}
@@ -0,0 +1,50 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "hough-plane.h"
+
+/* Decodes image files ahead of recognition. Decoder threads read the
+ * files into pooled buffers and convert them to 8-bit gray in a fixed
+ * number of pooled slots, handed out through a bounded lock-free queue,
+ * so reading, decoding and recognition overlap and memory stays the
+ * same however many files there are. */
+typedef struct image_loader image_loader;
+
+typedef struct loaded_image
+{
+  /* position in the file list */
+  int index;
+  const gchar *path;
+  /* 8-bit gray, valid until image_loader_release() */
+  hough_plane plane;
+  /* set if the file could not be read or decoded */
+  GError *error;
+} loaded_image;
+
+/* Starts n_decoders threads over the paths, which must outlive the
+ * loader, with n_slots images decoded at most. JPEGs are decoded
+ * reduced as long as the digit stays digit_height rows tall, see
+ * jpeg_decode_gray(), 0 keeps them full size. */
+image_loader*
+image_loader_new(gchar **paths,
+                 int n_paths,
+                 int n_decoders,
+                 int n_slots,
+                 int digit_height,
+                 hough_threshold threshold);
+
+/* A decoded image in the order they are done, NULL once every path has
+ * been handed out. Any thread may call it. */
+loaded_image*
+image_loader_next(image_loader *loader);
+
+/* Gives the slot of the image back to the decoders */
+void
+image_loader_release(image_loader *loader,
+                     loaded_image *image);
+
+/* Waits for the decoders, every image must have been released */
+void
+image_loader_free(image_loader *loader);
+
+#endif // LOADER_H
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <gtk/gtk.h>
 #include "interface.h"
 
@@ -10,6 +12,7 @@ int main(int argc, char **argv)
   GtkApplication *app;
   int status;
 
+  srand(time(NULL));
   app = gtk_application_new(app_id, G_APPLICATION_FLAGS_NONE);
   g_signal_connect(app, "startup",
                    G_CALLBACK(on_startup),
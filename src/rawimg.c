@@ -0,0 +1,284 @@
+#include "rawimg.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 24
+#define ALIGN_UP(value, align) (((value) + (align) - 1) / (align) * (align))
+
+struct raw_container
+{
+  guchar *map;
+  gsize size;
+  int n_images;
+  const guchar *index;
+};
+
+G_DEFINE_QUARK(raw-error-quark, raw_error)
+
+static guint32
+read_u32(const guchar *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static guint64
+read_u64(const guchar *p)
+{
+  return read_u32(p) | ((guint64)read_u32(p + 4) << 32);
+}
+
+static void
+write_u32(guchar *p, guint32 value)
+{
+  for(int i = 0; i < 4; ++i)
+    p[i] = (value >> (8 * i)) & 0xff;
+}
+
+static void
+write_u64(guchar *p, guint64 value)
+{
+  write_u32(p, value & G_MAXUINT32);
+  write_u32(p + 4, value >> 32);
+}
+
+int
+raw_plane_rowstride(int width, int bits)
+{
+  /* rows are padded to whole 64-bit words */
+  if(bits == 1)
+    return ALIGN_UP(width, 64) / 8;
+  return ALIGN_UP(width, 8);
+}
+
+static gboolean
+check_entry(const raw_container *container,
+            const guchar *entry)
+{
+  guint64 offset;
+  guint32 width, height, rowstride, bits;
+
+  offset = read_u64(entry);
+  width = read_u32(entry + 8);
+  height = read_u32(entry + 12);
+  rowstride = read_u32(entry + 16);
+  bits = read_u32(entry + 20);
+
+  if(bits != 1 && bits != 8)
+    return FALSE;
+  if(width == 0 || height == 0 || width > G_MAXINT / 8)
+    return FALSE;
+  if(rowstride < (bits == 1 ? (width + 7) / 8 : width))
+    return FALSE;
+  if(offset > container->size ||
+     (guint64)rowstride * height > container->size - offset)
+    return FALSE;
+  return TRUE;
+}
+
+raw_container*
+raw_container_open(const gchar *path,
+                   GError **error)
+{
+  raw_container *container;
+  struct stat st;
+  guint32 index_offset;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    {
+      g_set_error(error, RAW_ERROR, RAW_ERROR_IO,
+                  "%s: %s", path, g_strerror(errno));
+      return NULL;
+    }
+  if(fstat(fd, &st) < 0 || st.st_size < HEADER_SIZE)
+    {
+      g_set_error(error, RAW_ERROR, RAW_ERROR_FORMAT,
+                  "%s: not a raw image container", path);
+      close(fd);
+      return NULL;
+    }
+
+  container = g_new0(raw_container, 1);
+  container->size = st.st_size;
+  container->map = mmap(NULL, container->size, PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(container->map == MAP_FAILED)
+    {
+      g_set_error(error, RAW_ERROR, RAW_ERROR_IO,
+                  "%s: %s", path, g_strerror(errno));
+      g_free(container);
+      return NULL;
+    }
+
+  container->n_images = read_u32(container->map + 8);
+  index_offset = read_u32(container->map + 12);
+  if(memcmp(container->map, RAW_MAGIC, 4) != 0 ||
+     read_u32(container->map + 4) != RAW_VERSION ||
+     container->n_images < 0 ||
+     index_offset > container->size ||
+     (guint64)container->n_images * ENTRY_SIZE >
+     container->size - index_offset)
+    {
+      g_set_error(error, RAW_ERROR, RAW_ERROR_FORMAT,
+                  "%s: not a raw image container", path);
+      raw_container_close(container);
+      return NULL;
+    }
+  container->index = container->map + index_offset;
+
+  for(int i = 0; i < container->n_images; ++i)
+    if(!check_entry(container, container->index + i * ENTRY_SIZE))
+      {
+        g_set_error(error, RAW_ERROR, RAW_ERROR_FORMAT,
+                    "%s: image %i is out of bounds", path, i);
+        raw_container_close(container);
+        return NULL;
+      }
+
+  madvise(container->map, container->size, MADV_SEQUENTIAL);
+  return container;
+}
+
+void
+raw_container_close(raw_container *container)
+{
+  munmap(container->map, container->size);
+  g_free(container);
+}
+
+int
+raw_container_get_n_images(const raw_container *container)
+{
+  return container->n_images;
+}
+
+gboolean
+raw_container_get_plane(const raw_container *container,
+                        int index,
+                        hough_plane *plane)
+{
+  const guchar *entry;
+
+  if(index < 0 || index >= container->n_images)
+    return FALSE;
+
+  entry = container->index + index * ENTRY_SIZE;
+  plane->pixels = container->map + read_u64(entry);
+  plane->width = read_u32(entry + 8);
+  plane->height = read_u32(entry + 12);
+  plane->rowstride = read_u32(entry + 16);
+  plane->bits = read_u32(entry + 20);
+  plane->n_channels = 1;
+  plane->offset = 0;
+  return TRUE;
+}
+
+static void
+pack_row(const hough_plane *plane, int y, int bits, guchar *row)
+{
+  const guchar *src;
+
+  if(bits == 1)
+    {
+      for(int j = 0; j < plane->width; ++j)
+        if(hough_plane_is_dark(plane, j, y))
+          row[j >> 3] |= 1 << (j & 7);
+    }
+  else if(plane->bits == 1)
+    {
+      for(int j = 0; j < plane->width; ++j)
+        row[j] = hough_plane_is_dark(plane, j, y) ? 0 : 255;
+    }
+  else
+    {
+      src = plane->pixels + (gsize)y * plane->rowstride;
+      for(int j = 0; j < plane->width; ++j)
+        row[j] = src[j * plane->n_channels];
+    }
+}
+
+gboolean
+raw_container_write(const gchar *path,
+                    const hough_plane *planes,
+                    int n_planes,
+                    int bits,
+                    GError **error)
+{
+  FILE *file;
+  guchar header[HEADER_SIZE];
+  guchar *index, *row;
+  guint64 offset;
+  int max_stride;
+  gboolean ok;
+
+  index = g_malloc0((gsize)n_planes * ENTRY_SIZE);
+  offset = ALIGN_UP(HEADER_SIZE + (guint64)n_planes * ENTRY_SIZE, RAW_ALIGN);
+  max_stride = 0;
+  for(int i = 0; i < n_planes; ++i)
+    {
+      int stride = raw_plane_rowstride(planes[i].width, bits);
+      guchar *entry = index + i * ENTRY_SIZE;
+
+      write_u64(entry, offset);
+      write_u32(entry + 8, planes[i].width);
+      write_u32(entry + 12, planes[i].height);
+      write_u32(entry + 16, stride);
+      write_u32(entry + 20, bits);
+      offset = ALIGN_UP(offset + (guint64)stride * planes[i].height, RAW_ALIGN);
+      max_stride = MAX(max_stride, stride);
+    }
+
+  memcpy(header, RAW_MAGIC, 4);
+  write_u32(header + 4, RAW_VERSION);
+  write_u32(header + 8, n_planes);
+  write_u32(header + 12, HEADER_SIZE);
+
+  file = fopen(path, "wb");
+  if(file == NULL)
+    {
+      g_set_error(error, RAW_ERROR, RAW_ERROR_IO,
+                  "%s: %s", path, g_strerror(errno));
+      g_free(index);
+      return FALSE;
+    }
+
+  ok = fwrite(header, HEADER_SIZE, 1, file) == 1;
+  if(n_planes > 0)
+    ok = ok && fwrite(index, (gsize)n_planes * ENTRY_SIZE, 1, file) == 1;
+
+  row = g_malloc0(MAX(max_stride, RAW_ALIGN));
+  for(int i = 0; ok && i < n_planes; ++i)
+    {
+      int stride = raw_plane_rowstride(planes[i].width, bits);
+      long pad;
+
+      /* pad up to the aligned start of the plane */
+      pad = read_u64(index + i * ENTRY_SIZE) - ftell(file);
+      memset(row, 0, MAX(max_stride, RAW_ALIGN));
+      ok = pad == 0 || fwrite(row, pad, 1, file) == 1;
+
+      for(int y = 0; ok && y < planes[i].height; ++y)
+        {
+          memset(row, 0, stride);
+          pack_row(&planes[i], y, bits, row);
+          ok = fwrite(row, stride, 1, file) == 1;
+        }
+    }
+  g_free(row);
+  g_free(index);
+
+  if(fclose(file) != 0)
+    ok = FALSE;
+  if(!ok)
+    g_set_error(error, RAW_ERROR, RAW_ERROR_IO,
+                "%s: write failed", path);
+  return ok;
+}
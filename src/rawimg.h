@@ -0,0 +1,55 @@
+#ifndef RAWIMG_H
+#define RAWIMG_H
+
+#include <glib.h>
+#include "hough-plane.h"
+
+/* On-disk layout (little endian):
+ *   header  "HRAW", version, number of images, index offset
+ *   index   per image: data offset (64 bit), width, height, rowstride, bits
+ *   data    raw planes, each aligned to RAW_ALIGN bytes
+ * Planes are either 8-bit grayscale or 1-bit packed (see hough_plane). */
+
+#define RAW_MAGIC "HRAW"
+#define RAW_VERSION 1
+#define RAW_ALIGN 64
+
+#define RAW_ERROR (raw_error_quark())
+
+typedef enum
+{
+  RAW_ERROR_FORMAT,
+  RAW_ERROR_IO
+} RawError;
+
+typedef struct raw_container raw_container;
+
+GQuark
+raw_error_quark(void);
+
+raw_container*
+raw_container_open(const gchar *path,
+                   GError **error);
+
+void
+raw_container_close(raw_container *container);
+
+int
+raw_container_get_n_images(const raw_container *container);
+
+gboolean
+raw_container_get_plane(const raw_container *container,
+                        int index,
+                        hough_plane *plane);
+
+int
+raw_plane_rowstride(int width, int bits);
+
+gboolean
+raw_container_write(const gchar *path,
+                    const hough_plane *planes,
+                    int n_planes,
+                    int bits,
+                    GError **error);
+
+#endif // RAWIMG_H
@@ -0,0 +1,434 @@
+#include "shmring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_ALIGN 64
+#define MAX_SLOTS 4096
+/* how often a producer waiting for results checks the daemon lives */
+#define LIVENESS_MS 200
+#define ALIGN_UP(value, align) (((value) + (align) - 1) / (align) * (align))
+
+/* Counters only grow, ring positions are taken modulo n_slots. Fields
+ * written by different processes sit on separate cache lines. */
+typedef struct ring_header
+{
+  char magic[4];
+  guint32 version;
+  guint32 n_slots;
+  /* process of the daemon that created the segment */
+  gint32 daemon_pid;
+  guint64 slot_size;
+  guchar pad1[RING_ALIGN - 24];
+  /* producer */
+  gint submit_head;
+  gint complete_tail;
+  guchar pad2[RING_ALIGN - 2 * sizeof(gint)];
+  /* request thread */
+  gint submit_tail;
+  gint submit_sleeping;
+  guchar pad3[RING_ALIGN - 2 * sizeof(gint)];
+  /* completing threads */
+  gint complete_reserve;
+  gint result_sleeping;
+  guchar pad4[RING_ALIGN - 2 * sizeof(gint)];
+} ring_header;
+
+typedef struct submit_entry
+{
+  gint32 slot;
+  guint32 id;
+  gint32 width;
+  gint32 height;
+  gint32 rowstride;
+  gint32 bits;
+} submit_entry;
+
+/* seq is position + 1 once the entry at that position is written */
+typedef struct complete_entry
+{
+  gint seq;
+  guint32 id;
+  gint32 slot;
+  gint32 digit;
+  gint32 confidence;
+} complete_entry;
+
+struct shm_ring
+{
+  guchar *map;
+  gsize size;
+  ring_header *header;
+  submit_entry *submits;
+  complete_entry *completes;
+  guchar *slots;
+  int n_slots;
+  gsize slot_size;
+  /* creator unlinks the segment on close */
+  gchar *name;
+  /* producer side bookkeeping, local to the process */
+  int *free_slots;
+  int n_free;
+};
+
+G_DEFINE_QUARK(shm-ring-error-quark, shm_ring_error)
+
+/* Sleeps while *word is value, at most timeout if not NULL */
+static void
+futex_wait(gint *word, gint value, const struct timespec *timeout)
+{
+  syscall(SYS_futex, word, FUTEX_WAIT, value, timeout, NULL, 0);
+}
+
+static void
+futex_wake(gint *word)
+{
+  syscall(SYS_futex, word, FUTEX_WAKE, G_MAXINT, NULL, NULL, 0);
+}
+
+static gsize
+segment_size(int n_slots, gsize slot_size, gsize *submits,
+             gsize *completes, gsize *slots)
+{
+  *submits = sizeof(ring_header);
+  *completes = ALIGN_UP(*submits + n_slots * sizeof(submit_entry),
+                        RING_ALIGN);
+  *slots = ALIGN_UP(*completes + n_slots * sizeof(complete_entry),
+                    RING_ALIGN);
+  return *slots + n_slots * ALIGN_UP(slot_size, RING_ALIGN);
+}
+
+static shm_ring*
+map_segment(const gchar *name, int fd, gsize size, GError **error)
+{
+  shm_ring *ring;
+
+  ring = g_new0(shm_ring, 1);
+  ring->size = size;
+  ring->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(ring->map == MAP_FAILED)
+    {
+      g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_IO,
+                  "%s: %s", name, g_strerror(errno));
+      g_free(ring);
+      return NULL;
+    }
+  ring->header = (ring_header*)ring->map;
+  return ring;
+}
+
+static void
+locate(shm_ring *ring)
+{
+  gsize submits, completes, slots;
+
+  segment_size(ring->n_slots, ring->slot_size,
+               &submits, &completes, &slots);
+  ring->submits = (submit_entry*)(ring->map + submits);
+  ring->completes = (complete_entry*)(ring->map + completes);
+  ring->slots = ring->map + slots;
+}
+
+shm_ring*
+shm_ring_create(const gchar *name,
+                int n_slots,
+                gsize slot_size,
+                GError **error)
+{
+  shm_ring *ring;
+  gsize size, submits, completes, slots;
+  int fd;
+
+  if(n_slots <= 0 || n_slots > MAX_SLOTS || slot_size == 0)
+    {
+      g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_FORMAT,
+                  "%s: bad ring geometry", name);
+      return NULL;
+    }
+  size = segment_size(n_slots, slot_size, &submits, &completes, &slots);
+
+  shm_unlink(name);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0 || ftruncate(fd, size) < 0)
+    {
+      g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_IO,
+                  "%s: %s", name, g_strerror(errno));
+      if(fd >= 0)
+        {
+          close(fd);
+          shm_unlink(name);
+        }
+      return NULL;
+    }
+  ring = map_segment(name, fd, size, error);
+  close(fd);
+  if(ring == NULL)
+    {
+      shm_unlink(name);
+      return NULL;
+    }
+
+  ring->n_slots = n_slots;
+  ring->slot_size = slot_size;
+  ring->name = g_strdup(name);
+  locate(ring);
+
+  /* a fresh segment is zero filled, the header goes in last */
+  ring->header->n_slots = n_slots;
+  ring->header->daemon_pid = getpid();
+  ring->header->slot_size = slot_size;
+  ring->header->version = SHM_RING_VERSION;
+  __sync_synchronize();
+  memcpy(ring->header->magic, SHM_RING_MAGIC, 4);
+  return ring;
+}
+
+shm_ring*
+shm_ring_open(const gchar *name,
+              GError **error)
+{
+  shm_ring *ring;
+  ring_header header;
+  struct stat st;
+  gsize submits, completes, slots;
+  int fd;
+
+  fd = shm_open(name, O_RDWR, 0);
+  if(fd < 0)
+    {
+      g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_IO,
+                  "%s: %s", name, g_strerror(errno));
+      return NULL;
+    }
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ring_header) ||
+     pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+     memcmp(header.magic, SHM_RING_MAGIC, 4) != 0 ||
+     header.version != SHM_RING_VERSION ||
+     header.n_slots == 0 || header.n_slots > MAX_SLOTS ||
+     header.slot_size == 0 ||
+     segment_size(header.n_slots, header.slot_size,
+                  &submits, &completes, &slots) > (guint64)st.st_size)
+    {
+      g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_FORMAT,
+                  "%s: not a frame ring", name);
+      close(fd);
+      return NULL;
+    }
+
+  ring = map_segment(name, fd, st.st_size, error);
+  close(fd);
+  if(ring == NULL)
+    return NULL;
+
+  ring->n_slots = header.n_slots;
+  ring->slot_size = header.slot_size;
+  locate(ring);
+
+  /* frames a previous producer left behind are still going to be
+   * answered if the daemon lives; wait for them, after that every slot
+   * is free */
+  while(ring->header->complete_tail != ring->header->submit_head)
+    {
+      shm_ring_result result;
+
+      if(!shm_ring_next_result(ring, TRUE, &result))
+        {
+          g_set_error(error, SHM_RING_ERROR, SHM_RING_ERROR_GONE,
+                      "%s: the daemon of the ring has exited", name);
+          shm_ring_close(ring);
+          return NULL;
+        }
+    }
+  ring->free_slots = g_new(int, ring->n_slots);
+  for(int i = 0; i < ring->n_slots; ++i)
+    ring->free_slots[ring->n_free++] = ring->n_slots - 1 - i;
+  return ring;
+}
+
+void
+shm_ring_close(shm_ring *ring)
+{
+  munmap(ring->map, ring->size);
+  if(ring->name != NULL)
+    shm_unlink(ring->name);
+  g_free(ring->name);
+  g_free(ring->free_slots);
+  g_free(ring);
+}
+
+int
+shm_ring_acquire(shm_ring *ring)
+{
+  if(ring->n_free == 0)
+    return -1;
+  return ring->free_slots[--ring->n_free];
+}
+
+guchar*
+shm_ring_pixels(shm_ring *ring,
+                int slot)
+{
+  return ring->slots + slot * ALIGN_UP(ring->slot_size, RING_ALIGN);
+}
+
+gsize
+shm_ring_slot_size(const shm_ring *ring)
+{
+  return ring->slot_size;
+}
+
+void
+shm_ring_submit(shm_ring *ring,
+                int slot,
+                guint32 id,
+                int width, int height,
+                int rowstride, int bits)
+{
+  ring_header *header = ring->header;
+  gint head = header->submit_head;
+  submit_entry *entry = &ring->submits[(guint)head % ring->n_slots];
+
+  entry->slot = slot;
+  entry->id = id;
+  entry->width = width;
+  entry->height = height;
+  entry->rowstride = rowstride;
+  entry->bits = bits;
+  g_atomic_int_set(&header->submit_head, head + 1);
+  if(g_atomic_int_get(&header->submit_sleeping))
+    futex_wake(&header->submit_head);
+}
+
+static gboolean
+check_request(const shm_ring *ring, const submit_entry *entry)
+{
+  if(entry->slot < 0 || entry->slot >= ring->n_slots)
+    return FALSE;
+  if(entry->bits != 1 && entry->bits != 8)
+    return FALSE;
+  if(entry->width <= 0 || entry->height <= 0 || entry->rowstride <= 0)
+    return FALSE;
+  if(entry->rowstride < (entry->bits == 1 ? (entry->width + 7) / 8 :
+                         entry->width))
+    return FALSE;
+  return (guint64)entry->rowstride * entry->height <= ring->slot_size;
+}
+
+void
+shm_ring_next_request(shm_ring *ring,
+                      int *slot,
+                      guint32 *id,
+                      hough_plane *plane)
+{
+  ring_header *header = ring->header;
+
+  for(;;)
+    {
+      gint tail = header->submit_tail;
+      submit_entry entry;
+
+      if(g_atomic_int_get(&header->submit_head) == tail)
+        {
+          /* announce the sleep before the last look, the producer
+           * checks the flag after publishing */
+          g_atomic_int_set(&header->submit_sleeping, 1);
+          if(g_atomic_int_get(&header->submit_head) == tail)
+            futex_wait(&header->submit_head, tail, NULL);
+          g_atomic_int_set(&header->submit_sleeping, 0);
+          continue;
+        }
+
+      entry = ring->submits[(guint)tail % ring->n_slots];
+      g_atomic_int_set(&header->submit_tail, tail + 1);
+      if(!check_request(ring, &entry))
+        {
+          if(entry.slot >= 0 && entry.slot < ring->n_slots)
+            shm_ring_complete(ring, entry.slot, entry.id, -1, 0);
+          continue;
+        }
+
+      *slot = entry.slot;
+      *id = entry.id;
+      plane->pixels = shm_ring_pixels(ring, entry.slot);
+      plane->width = entry.width;
+      plane->height = entry.height;
+      plane->rowstride = entry.rowstride;
+      plane->n_channels = 1;
+      plane->bits = entry.bits;
+      plane->offset = 0;
+      return;
+    }
+}
+
+void
+shm_ring_complete(shm_ring *ring,
+                  int slot,
+                  guint32 id,
+                  int digit,
+                  int confidence)
+{
+  ring_header *header = ring->header;
+  gint position;
+  complete_entry *entry;
+
+  /* at most n_slots frames are out, so the entry a whole ring back has
+   * already been taken by the producer */
+  position = g_atomic_int_add(&header->complete_reserve, 1);
+  entry = &ring->completes[(guint)position % ring->n_slots];
+  entry->id = id;
+  entry->slot = slot;
+  entry->digit = digit;
+  entry->confidence = confidence;
+  g_atomic_int_set(&entry->seq, position + 1);
+  if(g_atomic_int_get(&header->result_sleeping))
+    futex_wake(&entry->seq);
+}
+
+static gboolean
+daemon_alive(const shm_ring *ring)
+{
+  pid_t pid = ring->header->daemon_pid;
+
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+gboolean
+shm_ring_next_result(shm_ring *ring,
+                     gboolean wait,
+                     shm_ring_result *result)
+{
+  ring_header *header = ring->header;
+  complete_entry *entry;
+  gint tail, expected, seq;
+
+  tail = header->complete_tail;
+  entry = &ring->completes[(guint)tail % ring->n_slots];
+  expected = tail + 1;
+  while((seq = g_atomic_int_get(&entry->seq)) != expected)
+    {
+      struct timespec timeout = {0, LIVENESS_MS * 1000000L};
+
+      if(!wait || !daemon_alive(ring))
+        return FALSE;
+      g_atomic_int_set(&header->result_sleeping, 1);
+      if(g_atomic_int_get(&entry->seq) == seq)
+        futex_wait(&entry->seq, seq, &timeout);
+      g_atomic_int_set(&header->result_sleeping, 0);
+    }
+
+  result->id = entry->id;
+  result->slot = entry->slot;
+  result->digit = entry->digit;
+  result->confidence = entry->confidence;
+  g_atomic_int_set(&header->complete_tail, tail + 1);
+  if(ring->free_slots != NULL && result->slot >= 0 &&
+     result->slot < ring->n_slots)
+    ring->free_slots[ring->n_free++] = result->slot;
+  return TRUE;
+}
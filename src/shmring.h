@@ -0,0 +1,97 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <glib.h>
+#include "hough-plane.h"
+
+/* Frames shared with the recognition daemon through POSIX shared memory
+ * (shm_open). The segment holds n_slots frame slots and two rings of
+ * slot numbers: submitted frames from the producer to the daemon and
+ * results back. Both rings are lock-free, waiting sides sleep on
+ * futexes in the segment. A slot belongs to the producer until it is
+ * submitted and comes back with its result. There is one producer and
+ * one thread taking requests per segment, any number of threads may
+ * complete them. A producer waiting for results gives up once the
+ * daemon's process is gone, which it looks up by pid, so both have to
+ * run in the same pid namespace. */
+
+#define SHM_RING_MAGIC "HSHM"
+#define SHM_RING_VERSION 2
+
+#define SHM_RING_ERROR (shm_ring_error_quark())
+
+typedef enum
+{
+  SHM_RING_ERROR_FORMAT,
+  SHM_RING_ERROR_IO,
+  /* the daemon died with frames of an earlier producer unanswered */
+  SHM_RING_ERROR_GONE
+} ShmRingError;
+
+typedef struct shm_ring shm_ring;
+
+typedef struct shm_ring_result
+{
+  guint32 id;
+  int slot;
+  int digit;
+  /* in 1/1000 */
+  int confidence;
+} shm_ring_result;
+
+GQuark
+shm_ring_error_quark(void);
+
+/* daemon side */
+shm_ring*
+shm_ring_create(const gchar *name,
+                int n_slots,
+                gsize slot_size,
+                GError **error);
+
+void
+shm_ring_next_request(shm_ring *ring,
+                      int *slot,
+                      guint32 *id,
+                      hough_plane *plane);
+
+void
+shm_ring_complete(shm_ring *ring,
+                  int slot,
+                  guint32 id,
+                  int digit,
+                  int confidence);
+
+/* producer side */
+shm_ring*
+shm_ring_open(const gchar *name,
+              GError **error);
+
+int
+shm_ring_acquire(shm_ring *ring);
+
+guchar*
+shm_ring_pixels(shm_ring *ring,
+                int slot);
+
+gsize
+shm_ring_slot_size(const shm_ring *ring);
+
+void
+shm_ring_submit(shm_ring *ring,
+                int slot,
+                guint32 id,
+                int width, int height,
+                int rowstride, int bits);
+
+/* The next result, waiting for it if wait. FALSE if there is none yet
+ * and wait is not set, or if the daemon has exited. */
+gboolean
+shm_ring_next_result(shm_ring *ring,
+                     gboolean wait,
+                     shm_ring_result *result);
+
+void
+shm_ring_close(shm_ring *ring);
+
+#endif // SHMRING_H
@@ -0,0 +1,254 @@
+#include "stream.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "loader.h"
+
+#define FRAME_HEADER_SIZE 16
+#define MAX_SIDE 16384
+#define MIN_MARGIN 8
+#define MARGIN_RATIO 8
+/* frames decoded ahead of the one recognized */
+#define STREAM_PREFETCH 4
+
+/* What the previous frame left behind: where the digit was and what it
+ * was recognized as */
+typedef struct stream_state
+{
+  const hough_options *options;
+  hough_threshold threshold;
+  gboolean tracking;
+  int x, y, width, height;
+  gboolean have_result;
+  guint64 hash;
+  int digit;
+  double confidence;
+  int n_frames;
+  int n_tracked;
+  int n_reused;
+} stream_state;
+
+static void
+stream_frame(stream_state *state, const hough_plane *frame)
+{
+  const hough_options *options = state->options;
+  hough_plane cleaned, cropped;
+  const hough_plane *plane;
+  guchar *buffer;
+  gboolean found;
+  guint64 hash;
+  int index;
+
+  buffer = NULL;
+  plane = frame;
+  if(options->open_radius > 0 || options->close_radius > 0)
+    {
+      buffer = hough_plane_clean(frame, options->open_radius,
+                                 options->close_radius, &cleaned);
+      plane = &cleaned;
+    }
+
+  index = state->n_frames++;
+  found = FALSE;
+  if(state->tracking)
+    {
+      int margin = MAX(MIN_MARGIN, state->height / MARGIN_RATIO);
+      found = hough_plane_bbox_near(plane, &state->x, &state->y,
+                                    &state->width, &state->height, margin);
+      if(found)
+        state->n_tracked++;
+    }
+  /* a lost digit is looked for over the whole frame with every core */
+  if(!found)
+    found = hough_plane_bbox_parallel(plane, &state->x, &state->y,
+                                      &state->width, &state->height);
+  state->tracking = found;
+
+  if(!found)
+    {
+      state->have_result = FALSE;
+      g_print("%i: -1 0.000\n", index);
+      fflush(stdout);
+      g_free(buffer);
+      return;
+    }
+
+  /* the digit under the camera often does not change between frames */
+  hough_plane_sub(plane, state->x, state->y,
+                  state->width, state->height, &cropped);
+  hash = hough_plane_hash(&cropped);
+  if(state->have_result && hash == state->hash)
+    state->n_reused++;
+  else
+    {
+      state->digit = recognize_cropped(&cropped, state->options,
+                                       &state->confidence);
+      state->hash = hash;
+      state->have_result = TRUE;
+    }
+
+  g_print("%i: %i %.3f\n", index, state->digit, state->confidence);
+  fflush(stdout);
+  g_free(buffer);
+}
+
+static gboolean
+read_full(int fd, guchar *data, gsize size)
+{
+  while(size > 0)
+    {
+      ssize_t n = read(fd, data, size);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        return FALSE;
+      data += n;
+      size -= n;
+    }
+  return TRUE;
+}
+
+static guint32
+read_u32(const guchar *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32)p[3] << 24);
+}
+
+static gboolean
+stream_pipe(stream_state *state, int fd)
+{
+  guchar header[FRAME_HEADER_SIZE];
+  guchar *buffer;
+  gsize capacity;
+
+  buffer = NULL;
+  capacity = 0;
+  while(read_full(fd, header, FRAME_HEADER_SIZE))
+    {
+      hough_plane plane;
+      guint32 width, height, bits, stride;
+
+      width = read_u32(header + 4);
+      height = read_u32(header + 8);
+      bits = read_u32(header + 12);
+      if((bits != 1 && bits != 8) ||
+         width == 0 || width > MAX_SIDE ||
+         height == 0 || height > MAX_SIDE)
+        {
+          g_printerr("frame %i: bad header\n", state->n_frames);
+          g_free(buffer);
+          return FALSE;
+        }
+      stride = bits == 1 ? (width + 7) / 8 : width;
+      if(capacity < (gsize)stride * height)
+        {
+          capacity = (gsize)stride * height;
+          buffer = g_realloc(buffer, capacity);
+        }
+      if(!read_full(fd, buffer, (gsize)stride * height))
+        {
+          g_printerr("frame %i: truncated\n", state->n_frames);
+          g_free(buffer);
+          return FALSE;
+        }
+
+      plane.pixels = buffer;
+      plane.width = width;
+      plane.height = height;
+      plane.rowstride = stride;
+      plane.n_channels = 1;
+      plane.bits = bits;
+      plane.offset = 0;
+      stream_frame(state, &plane);
+    }
+  g_free(buffer);
+  return TRUE;
+}
+
+static gint
+compare_names(gconstpointer a, gconstpointer b)
+{
+  return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+static gboolean
+stream_directory(stream_state *state, const gchar *path)
+{
+  GPtrArray *names;
+  GError *error;
+  GDir *dir;
+  const gchar *name;
+  image_loader *loader;
+  loaded_image *image;
+  gboolean ok;
+
+  error = NULL;
+  dir = g_dir_open(path, 0, &error);
+  if(dir == NULL)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return FALSE;
+    }
+  names = g_ptr_array_new_with_free_func(g_free);
+  while((name = g_dir_read_name(dir)) != NULL)
+    g_ptr_array_add(names, g_build_filename(path, name, NULL));
+  g_dir_close(dir);
+  g_ptr_array_sort(names, compare_names);
+
+  /* a single decoder hands the frames out in name order */
+  loader = image_loader_new((gchar**)names->pdata, names->len, 1,
+                            STREAM_PREFETCH,
+                            state->options->canonical_height,
+                            state->threshold);
+  ok = TRUE;
+  while((image = image_loader_next(loader)) != NULL)
+    {
+      hough_plane binary;
+      guchar *buffer;
+
+      if(image->error != NULL)
+        {
+          g_printerr("%s\n", image->error->message);
+          ok = FALSE;
+          image_loader_release(loader, image);
+          continue;
+        }
+      buffer = hough_plane_threshold_parallel(&image->plane,
+                                              state->threshold, &binary);
+      image_loader_release(loader, image);
+      stream_frame(state, &binary);
+      g_free(buffer);
+    }
+  image_loader_free(loader);
+
+  g_ptr_array_unref(names);
+  return ok;
+}
+
+int
+stream_frames(const gchar *source,
+              hough_threshold threshold,
+              const hough_options *options)
+{
+  stream_state state;
+  gint64 start;
+  gboolean ok;
+
+  memset(&state, 0, sizeof(state));
+  state.options = options;
+  state.threshold = threshold;
+
+  start = g_get_monotonic_time();
+  if(strcmp(source, "-") == 0)
+    ok = stream_pipe(&state, STDIN_FILENO);
+  else
+    ok = stream_directory(&state, source);
+
+  g_printerr("%i frames, %i tracked, %i reused, %.1f fps\n",
+             state.n_frames, state.n_tracked, state.n_reused,
+             state.n_frames * 1e6 / MAX(g_get_monotonic_time() - start, 1));
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
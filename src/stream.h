@@ -0,0 +1,15 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "hough-recog.h"
+
+/* Recognizes a frame sequence, a directory of images in name order or
+ * "-" for frames piped to stdin with hough-daemon request framing, and
+ * prints a line per frame as soon as it is done. Decoded images are
+ * binarized with the given threshold. */
+int
+stream_frames(const gchar *source,
+              hough_threshold threshold,
+              const hough_options *options);
+
+#endif // STREAM_H
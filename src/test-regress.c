@@ -0,0 +1,442 @@
+/* Accuracy and throughput of the recognizers over a labelled corpus:
+ * the draw_digit() set, clean, with noise() and with breach(), and the
+ * images of a directory if one is given. Prints a confusion matrix,
+ * the accuracy and the images per second of every variant and fails if
+ * the accuracy of one of them falls behind the stored baseline by more
+ * than the tolerance, or if the baseline is missing or made for other
+ * images. The speed depends on the machine, so it is only checked when
+ * a speed tolerance is given, against a baseline saved on that machine. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imgproc.h"
+#include "hough-pixbuf.h"
+
+#define N_DIGITS 10
+#define BASELINE_NAME "regress-baseline"
+#define SPEED_TOLERANCE_VARIABLE "HOUGH_SPEED_TOLERANCE"
+
+typedef struct sample
+{
+  GdkPixbuf *image;
+  int digit;
+} sample;
+
+typedef struct variant
+{
+  const gchar *name;
+  /* classify_pixbuf() like the application, else recognize_plane() */
+  gboolean application;
+  hough_vote_mode vote_mode;
+  hough_classifier classifier;
+  gboolean deskew;
+  gboolean arcs;
+} variant;
+
+typedef struct outcome
+{
+  /* rows are the labels, the last column counts unrecognized images */
+  int confusion[N_DIGITS][N_DIGITS + 1];
+  int correct;
+  double accuracy;
+  double rate;
+} outcome;
+
+static const variant variants[] =
+{
+  {"classify", TRUE, HOUGH_VOTE_FULL, HOUGH_CLASSIFY_LINES, FALSE, FALSE},
+  {"lines", FALSE, HOUGH_VOTE_FULL, HOUGH_CLASSIFY_LINES, FALSE, FALSE},
+  {"sampled", FALSE, HOUGH_VOTE_SAMPLED, HOUGH_CLASSIFY_LINES, FALSE, FALSE},
+  {"oriented", FALSE, HOUGH_VOTE_ORIENTED, HOUGH_CLASSIFY_LINES,
+   FALSE, FALSE},
+  {"deskew", FALSE, HOUGH_VOTE_ORIENTED, HOUGH_CLASSIFY_LINES, TRUE, FALSE},
+  {"arcs", FALSE, HOUGH_VOTE_ORIENTED, HOUGH_CLASSIFY_LINES, FALSE, TRUE},
+  {"template", FALSE, HOUGH_VOTE_FULL, HOUGH_CLASSIFY_TEMPLATE,
+   FALSE, FALSE}
+};
+
+static int copies = 4;
+static int seed = 1;
+static int rounds = 5;
+static gchar *corpus_dir = NULL;
+static gchar *baseline_path = NULL;
+static gchar *only = NULL;
+static double accuracy_tolerance = 0.01;
+/* negative: the speed is not checked */
+static double speed_tolerance = -1;
+static gboolean save = FALSE;
+
+static GOptionEntry entries[] =
+{
+  {"copies", 'n', 0, G_OPTION_ARG_INT, &copies,
+   "Copies of every drawn digit with noise and with breaches", "N"},
+  {"seed", 0, 0, G_OPTION_ARG_INT, &seed,
+   "Seed of the noise and the breaches", "N"},
+  {"rounds", 'r', 0, G_OPTION_ARG_INT, &rounds,
+   "Times the corpus is recognized, the fastest counts", "N"},
+  {"corpus", 'C', 0, G_OPTION_ARG_FILENAME, &corpus_dir,
+   "Also the images of DIR, labelled by DIR/manifest or their first "
+   "character", "DIR"},
+  {"baseline", 'B', 0, G_OPTION_ARG_FILENAME, &baseline_path,
+   "Baseline file, $srcdir/" BASELINE_NAME " by default", "FILE"},
+  {"variants", 'V', 0, G_OPTION_ARG_STRING, &only,
+   "Comma separated variants to run, all by default", "LIST"},
+  {"accuracy-tolerance", 0, 0, G_OPTION_ARG_DOUBLE, &accuracy_tolerance,
+   "Allowed drop of accuracy, as a fraction of the images", "X"},
+  {"speed-tolerance", 0, 0, G_OPTION_ARG_DOUBLE, &speed_tolerance,
+   "Allowed drop of images per second, as a fraction of the baseline, "
+   "$" SPEED_TOLERANCE_VARIABLE " by default; the speed is not checked "
+   "without it", "X"},
+  {"save-baseline", 0, 0, G_OPTION_ARG_NONE, &save,
+   "Write the results as the new baseline instead of checking them", NULL},
+  {NULL}
+};
+
+static void
+add_sample(GArray *samples, GdkPixbuf *image, int digit)
+{
+  sample s;
+
+  s.image = image;
+  s.digit = digit;
+  g_array_append_val(samples, s);
+}
+
+static void
+generate_samples(GArray *samples)
+{
+  srand(seed);
+  for(int d = 0; d < N_DIGITS; ++d)
+    {
+      GdkPixbuf *clean = draw_digit(d);
+
+      add_sample(samples, clean, d);
+      for(int c = 0; c < copies; ++c)
+        {
+          add_sample(samples, noise(clean), d);
+          add_sample(samples, breach(clean), d);
+        }
+    }
+}
+
+static gboolean
+load_image(GArray *samples, const gchar *dir, const gchar *name, int digit,
+           GError **error)
+{
+  GdkPixbuf *image;
+  gchar *path;
+
+  path = g_build_filename(dir, name, NULL);
+  image = gdk_pixbuf_new_from_file(path, error);
+  g_free(path);
+  if(image == NULL)
+    return FALSE;
+  add_sample(samples, image, digit);
+  return TRUE;
+}
+
+/* Lines "FILE DIGIT" of the manifest, # starts a comment. Without a
+ * manifest every file named after its digit, like 7.jpg or 7-12.png. */
+static gboolean
+load_corpus(GArray *samples, const gchar *dir, GError **error)
+{
+  gchar *path, *contents;
+  gboolean ok;
+
+  ok = TRUE;
+  path = g_build_filename(dir, "manifest", NULL);
+  if(g_file_get_contents(path, &contents, NULL, NULL))
+    {
+      gchar **lines = g_strsplit(contents, "\n", -1);
+
+      for(int k = 0; ok && lines[k] != NULL; ++k)
+        {
+          gchar *line = g_strstrip(lines[k]), *label;
+
+          if(line[0] == '\0' || line[0] == '#')
+            continue;
+          label = strrchr(line, ' ');
+          if(label == NULL || !g_ascii_isdigit(label[1]) || label[2] != '\0')
+            {
+              g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                          "%s:%i: expected FILE DIGIT", path, k + 1);
+              ok = FALSE;
+              break;
+            }
+          *label = '\0';
+          ok = load_image(samples, dir, g_strchomp(line), label[1] - '0',
+                          error);
+        }
+      g_strfreev(lines);
+      g_free(contents);
+    }
+  else
+    {
+      GDir *listing = g_dir_open(dir, 0, error);
+      const gchar *name;
+
+      ok = listing != NULL;
+      while(ok && (name = g_dir_read_name(listing)) != NULL)
+        if(g_ascii_isdigit(name[0]))
+          ok = load_image(samples, dir, name, name[0] - '0', error);
+      if(listing != NULL)
+        g_dir_close(listing);
+    }
+  g_free(path);
+  return ok;
+}
+
+static gboolean
+is_selected(const variant *v)
+{
+  gchar **names;
+  gboolean found;
+
+  if(only == NULL)
+    return TRUE;
+  names = g_strsplit(only, ",", -1);
+  found = g_strv_contains((const gchar * const*)names, v->name);
+  g_strfreev(names);
+  return found;
+}
+
+static void
+run_variant(const variant *v, GArray *samples, outcome *out)
+{
+  hough_options options;
+  hough_accum *accum;
+  gint64 fastest;
+
+  hough_options_init(&options);
+  options.vote_mode = v->vote_mode;
+  options.classifier = v->classifier;
+  options.deskew = v->deskew;
+  options.arcs = v->arcs;
+  accum = v->application ? hough_accum_new() : NULL;
+
+  memset(out, 0, sizeof(outcome));
+  fastest = G_MAXINT64;
+  for(int r = 0; r < rounds; ++r)
+    {
+      gint64 start = g_get_monotonic_time();
+
+      for(guint k = 0; k < samples->len; ++k)
+        {
+          const sample *s = &g_array_index(samples, sample, k);
+          int digit;
+
+          if(v->application)
+            digit = classify_pixbuf(s->image, accum);
+          else
+            {
+              hough_plane plane;
+
+              hough_plane_from_pixbuf(s->image, &plane);
+              digit = recognize_plane(&plane, &options);
+            }
+          if(r == 0)
+            {
+              out->confusion[s->digit][digit < 0 ? N_DIGITS : digit]++;
+              out->correct += digit == s->digit;
+            }
+        }
+      fastest = MIN(fastest, g_get_monotonic_time() - start);
+    }
+  if(accum != NULL)
+    hough_accum_free(accum);
+
+  out->accuracy = samples->len > 0 ? (double)out->correct / samples->len : 0;
+  out->rate = samples->len * 1e6 / MAX(1, fastest);
+}
+
+static void
+print_outcome(const variant *v, const outcome *out, int n_samples)
+{
+  g_print("%s: %.2f%% (%i/%i), %.1f images/s\n", v->name,
+          out->accuracy * 100, out->correct, n_samples, out->rate);
+  g_print("     ");
+  for(int d = 0; d < N_DIGITS; ++d)
+    g_print("%5i", d);
+  g_print("    -\n");
+  for(int d = 0; d < N_DIGITS; ++d)
+    {
+      g_print("%5i", d);
+      for(int a = 0; a <= N_DIGITS; ++a)
+        g_print("%5i", out->confusion[d][a]);
+      g_print("\n");
+    }
+}
+
+/* Lines "VARIANT ACCURACY RATE" after "images N", NULL if the file
+ * cannot be read */
+static GHashTable*
+read_baseline(const gchar *path, int *n_images)
+{
+  GHashTable *table;
+  gchar *contents, **lines;
+
+  if(!g_file_get_contents(path, &contents, NULL, NULL))
+    return NULL;
+  table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  *n_images = -1;
+  lines = g_strsplit(contents, "\n", -1);
+  for(int k = 0; lines[k] != NULL; ++k)
+    {
+      char name[64];
+      double *values = g_new(double, 2);
+
+      if(sscanf(lines[k], "images %i", n_images) == 1 ||
+         sscanf(lines[k], "%63s %lf %lf", name, &values[0], &values[1]) != 3 ||
+         name[0] == '#')
+        {
+          g_free(values);
+          continue;
+        }
+      g_hash_table_replace(table, g_strdup(name), values);
+    }
+  g_strfreev(lines);
+  g_free(contents);
+  return table;
+}
+
+static gboolean
+write_baseline(const gchar *path, const outcome *outcomes, int n_samples,
+               GError **error)
+{
+  GString *text;
+  gboolean ok;
+
+  text = g_string_new("# variant accuracy images/s, see test-regress --help\n");
+  g_string_append_printf(text, "images %i\n", n_samples);
+  for(int k = 0; k < G_N_ELEMENTS(variants); ++k)
+    if(is_selected(&variants[k]))
+      g_string_append_printf(text, "%s %.4f %.1f\n", variants[k].name,
+                             outcomes[k].accuracy, outcomes[k].rate);
+  ok = g_file_set_contents(path, text->str, text->len, error);
+  g_string_free(text, TRUE);
+  return ok;
+}
+
+static int
+check_baseline(GHashTable *baseline, const outcome *outcomes)
+{
+  int status;
+
+  status = EXIT_SUCCESS;
+  for(int k = 0; k < G_N_ELEMENTS(variants); ++k)
+    {
+      const double *base;
+
+      if(!is_selected(&variants[k]))
+        continue;
+      base = g_hash_table_lookup(baseline, variants[k].name);
+      if(base == NULL)
+        {
+          g_print("FAIL %s: not in the baseline\n", variants[k].name);
+          status = EXIT_FAILURE;
+          continue;
+        }
+      if(outcomes[k].accuracy < base[0] - accuracy_tolerance)
+        {
+          g_print("FAIL %s: accuracy %.2f%%, baseline %.2f%%\n",
+                  variants[k].name, outcomes[k].accuracy * 100,
+                  base[0] * 100);
+          status = EXIT_FAILURE;
+        }
+      if(speed_tolerance >= 0 &&
+         outcomes[k].rate < base[1] * (1 - speed_tolerance))
+        {
+          g_print("FAIL %s: %.1f images/s, baseline %.1f\n",
+                  variants[k].name, outcomes[k].rate, base[1]);
+          status = EXIT_FAILURE;
+        }
+    }
+  return status;
+}
+
+int main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error;
+  GArray *samples;
+  GHashTable *baseline;
+  outcome outcomes[G_N_ELEMENTS(variants)];
+  int status, n_images;
+
+  error = NULL;
+  context = g_option_context_new("- recognition regression test");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if(!g_option_context_parse(context, &argc, &argv, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(context);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free(context);
+  if(speed_tolerance < 0 && g_getenv(SPEED_TOLERANCE_VARIABLE) != NULL)
+    speed_tolerance = g_ascii_strtod(g_getenv(SPEED_TOLERANCE_VARIABLE),
+                                     NULL);
+  if(copies < 0 || rounds < 1)
+    {
+      g_printerr("--copies must not be negative, --rounds must be "
+                 "positive\n");
+      return EXIT_FAILURE;
+    }
+  if(baseline_path == NULL)
+    baseline_path = g_build_filename(g_getenv("srcdir") != NULL ?
+                                     g_getenv("srcdir") : ".",
+                                     BASELINE_NAME, NULL);
+
+  samples = g_array_new(FALSE, FALSE, sizeof(sample));
+  generate_samples(samples);
+  if(corpus_dir != NULL && !load_corpus(samples, corpus_dir, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+  for(int k = 0; k < G_N_ELEMENTS(variants); ++k)
+    if(is_selected(&variants[k]))
+      {
+        run_variant(&variants[k], samples, &outcomes[k]);
+        print_outcome(&variants[k], &outcomes[k], samples->len);
+      }
+
+  if(save)
+    {
+      status = EXIT_SUCCESS;
+      if(!write_baseline(baseline_path, outcomes, samples->len, &error))
+        {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+          status = EXIT_FAILURE;
+        }
+      else
+        g_print("baseline written to %s\n", baseline_path);
+    }
+  else if((baseline = read_baseline(baseline_path, &n_images)) == NULL)
+    {
+      g_print("FAIL no baseline in %s, record one with --save-baseline\n",
+              baseline_path);
+      status = EXIT_FAILURE;
+    }
+  else
+    {
+      if(n_images != (int)samples->len)
+        {
+          g_print("FAIL baseline of %i images, the corpus has %u\n",
+                  n_images, samples->len);
+          status = EXIT_FAILURE;
+        }
+      else
+        status = check_baseline(baseline, outcomes);
+      g_hash_table_destroy(baseline);
+    }
+
+  for(guint k = 0; k < samples->len; ++k)
+    g_object_unref(g_array_index(samples, sample, k).image);
+  g_array_free(samples, TRUE);
+  return status;
+}
@@ -0,0 +1,171 @@
+#include "view.h"
+#include <stdlib.h>
+#include "hough-dump.h"
+#include "hough-pixbuf.h"
+
+#define ROW_PIXELS 16
+#define FIRST_ANGLE -90
+#define ROW_ANGLE 45
+
+static void
+print_record(guint index, const hough_dump_record *record, GHashTable *table)
+{
+  const hough_result *result = &record->result;
+
+  g_print("%04u %s: %i %.3f, crop %ix%i, step %i, skew %i, %u lines\n",
+          index, record->label, result->digit, result->confidence,
+          result->crop_width, result->crop_height, result->angle_step,
+          result->skew, result->lines->len);
+  for(int row = 0; row < result->votes_height; ++row)
+    {
+      const int *votes = result->votes + row * result->votes_width;
+      int angle = FIRST_ANGLE + row * ROW_ANGLE;
+      int peak = 0;
+      GSList *lines;
+
+      for(int bin = 1; bin < result->votes_width; ++bin)
+        if(votes[bin] > votes[peak])
+          peak = bin;
+      g_print("  %4i: peak %i at %+i", angle, votes[peak],
+              peak - (result->votes_width - 1) / 2);
+      lines = g_hash_table_lookup(table, GINT_TO_POINTER(angle));
+      for(; lines != NULL; lines = lines->next)
+        {
+          const sl_value *line = lines->data;
+
+          g_print(", line %+i (%i)",
+                  line->bin - (result->votes_width - 1) / 2, line->points);
+        }
+      g_print("\n");
+    }
+}
+
+static GdkPixbuf*
+draw_votes(const hough_result *result, GHashTable *table)
+{
+  GdkPixbuf *image;
+  guchar *pixels;
+  int rowstride, most;
+
+  image = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, result->votes_width,
+                         result->votes_height * ROW_PIXELS);
+  pixels = gdk_pixbuf_get_pixels(image);
+  rowstride = gdk_pixbuf_get_rowstride(image);
+  most = 1;
+  for(int k = 0; k < result->votes_width * result->votes_height; ++k)
+    most = MAX(most, result->votes[k]);
+
+  for(int row = 0; row < result->votes_height; ++row)
+    {
+      const int *votes = result->votes + row * result->votes_width;
+      GSList *lines;
+
+      for(int bin = 0; bin < result->votes_width; ++bin)
+        {
+          guchar level = 255 - (guchar)(255L * votes[bin] / most);
+
+          for(int i = 0; i < ROW_PIXELS; ++i)
+            {
+              guchar *p = pixels + (row * ROW_PIXELS + i) * rowstride +
+                  bin * 3;
+
+              p[0] = p[1] = p[2] = level;
+            }
+        }
+      lines = g_hash_table_lookup(table, GINT_TO_POINTER(FIRST_ANGLE +
+                                                         row * ROW_ANGLE));
+      for(; lines != NULL; lines = lines->next)
+        for(int i = 0; i < ROW_PIXELS; ++i)
+          {
+            guchar *p = pixels + (row * ROW_PIXELS + i) * rowstride +
+                ((sl_value*)lines->data)->bin * 3;
+
+            p[0] = 255;
+            p[1] = p[2] = 0;
+          }
+    }
+  return image;
+}
+
+static gboolean
+save_images(const gchar *directory, guint index,
+            const hough_result *result, GHashTable *table)
+{
+  GdkPixbuf *image;
+  GError *error;
+  gchar *path;
+  gboolean ok;
+
+  error = NULL;
+  image = draw_votes(result, table);
+  path = g_strdup_printf("%s/%04u-votes.png", directory, index);
+  ok = gdk_pixbuf_save(image, path, "png", &error, NULL);
+  g_object_unref(image);
+  g_free(path);
+
+  if(ok)
+    {
+      image = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+                             MAX(1, result->crop_width),
+                             MAX(1, result->crop_height));
+      gdk_pixbuf_fill(image, 0xffffffff);
+      highlight(image, table);
+      path = g_strdup_printf("%s/%04u-lines.png", directory, index);
+      ok = gdk_pixbuf_save(image, path, "png", &error, NULL);
+      g_object_unref(image);
+      g_free(path);
+    }
+  if(!ok)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+    }
+  return ok;
+}
+
+int
+view_dump(const gchar *path,
+          const gchar *directory)
+{
+  hough_dump *dump;
+  hough_dump_record record;
+  GError *error;
+  gboolean ok;
+  guint index;
+
+  error = NULL;
+  dump = hough_dump_open(path, &error);
+  if(dump == NULL)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+  ok = TRUE;
+  for(index = 0; hough_dump_read(dump, &record, &error); ++index)
+    {
+      GHashTable *table;
+
+      /* the lines come out of the votes as they did when recognizing */
+      table = record.result.votes != NULL ?
+          filter_accum_matrix_scaled(record.result.votes,
+                                     record.result.votes_width,
+                                     record.result.votes_height,
+                                     record.result.votes_scale) :
+          g_hash_table_new(g_direct_hash, g_direct_equal);
+      print_record(index, &record, table);
+      if(directory != NULL && record.result.votes != NULL)
+        ok = save_images(directory, index, &record.result, table) && ok;
+      g_hash_table_destroy(table);
+      hough_dump_record_clear(&record);
+    }
+  if(error != NULL)
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      ok = FALSE;
+    }
+  hough_dump_close(dump, NULL);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <glib.h>
+
+/* Prints every record of a hough_dump with the peaks of its votes row
+ * by row. With a directory, also draws the votes of record N into
+ * NNNN-votes.png, a band per direction darker with more votes and the
+ * bins of the lines red, and the lines over the crop into
+ * NNNN-lines.png. */
+int
+view_dump(const gchar *path,
+          const gchar *directory);
+
+#endif // VIEW_H